@@ -0,0 +1,64 @@
+/**
+ * @brief Bump allocator backing a memTable.
+ *        Memory is handed out from large blocks and only released
+ *        all at once, when the Arena is cleared or destructed.
+ *        allocate() is safe to call from several threads.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "global.h"
+
+class Arena {
+
+private:
+
+    static const size_t BLOCK_SIZE = 1 << 16;
+
+    struct Block {
+        char *data;
+        size_t size;
+        std::atomic<size_t> used;
+        Block(char *d, size_t s): data(d), size(s), used(0) {}
+    };
+
+    std::atomic<Block*> current;  // block being bumped
+
+    std::mutex block_mutex;  // guards blocks, taken only when a block fills up
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+
+    std::atomic<size_t> memory_usage;
+
+    /**
+     * Allocate a block with bytes of space after its header.
+     */
+    Block *new_block(size_t bytes);
+
+public:
+
+    /**
+     * Construct an Arena holding one empty block.
+     */
+    Arena();
+
+    /**
+     * Allocate bytes aligned to 8, valid until clear() or destruction.
+     */
+    char *allocate(size_t bytes);
+
+    /**
+     * Release all blocks at once.
+     * No other thread may use the Arena meanwhile.
+     */
+    void clear();
+
+    /**
+     * @return total size of blocks held
+     */
+    size_t get_memory_usage() const;
+};
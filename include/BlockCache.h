@@ -0,0 +1,93 @@
+/**
+ * @brief Sharded LRU cache of SSTable blocks.
+ *        A block is a data block of an SSTable (or a BLOCK_SIZE-aligned window of
+ *        the value area of a legacy one), or a piece of its metadata,
+ *        keyed by (cache id of the table, block number).
+ *        Capacity is counted in bytes of cached data, split over shards.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "global.h"
+
+class BlockCache {
+
+public:
+
+    static const size_t BLOCK_SIZE = 1 << 12;
+
+    typedef std::shared_ptr<const std::string> block_ptr;
+
+private:
+
+    static const size_t SHARD_COUNT = 16;
+
+    struct BlockKey {
+        uint64_t table;
+        uint64_t block;
+        bool operator==(const BlockKey &other) const {
+            return table == other.table && block == other.block;
+        }
+    };
+
+    struct BlockKeyHash {
+        size_t operator()(const BlockKey &key) const {
+            return std::hash<uint64_t>()(key.table * 0x9E3779B97F4A7C15ULL + key.block);
+        }
+    };
+
+    struct Shard {
+        std::mutex shard_mutex;
+        std::list<std::pair<BlockKey, block_ptr>> lru;  // most recently used first
+        std::unordered_map<BlockKey, std::list<std::pair<BlockKey, block_ptr>>::iterator, BlockKeyHash> blocks;
+        size_t usage = 0;
+    };
+
+    const size_t shard_capacity;
+
+    Shard shards[SHARD_COUNT];
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    Shard &shard_of(const BlockKey &key);
+
+    /**
+     * Drop least recently used blocks of shard beyond capacity, keeping the newest one.
+     * Called with the shard locked.
+     */
+    void evict(Shard &shard);
+
+public:
+
+    /**
+     * Construct an empty cache holding at most capacity bytes.
+     */
+    explicit BlockCache(size_t capacity);
+
+    /**
+     * @return cached block, nullptr if missing
+     */
+    block_ptr lookup(uint64_t table, uint64_t block);
+
+    /**
+     * Cache a block, evicting least recently used ones beyond capacity.
+     * @return the cached block
+     */
+    block_ptr insert(uint64_t table, uint64_t block, std::string data);
+
+    /**
+     * @return number of lookups served from the cache
+     */
+    uint64_t get_hits() const;
+
+    /**
+     * @return number of lookups that missed
+     */
+    uint64_t get_misses() const;
+};
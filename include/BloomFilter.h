@@ -0,0 +1,33 @@
+/**
+ * @brief Split-block bloom filter over uint64 keys, stored as raw bytes.
+ *        Bits are grouped in BLOCK_BYTES blocks of eight 32-bit words. A key picks one
+ *        block by its hash and sets one bit in each word of it, so a probe reads a single
+ *        block and its eight word tests run as one vector operation.
+ *        The filter is sized from bits per key, about 1% false positives at 10.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace bloom {
+
+    const size_t BLOCK_BYTES = 32;
+
+    /**
+     * @return bytes of a filter for key_count keys, 0 (no filter) if bits_per_key is 0
+     */
+    size_t filter_size(uint64_t key_count, size_t bits_per_key);
+
+    /**
+     * Set bits of key in filter of size bytes (a multiple of BLOCK_BYTES).
+     */
+    void add(char *filter, size_t size, uint64_t key);
+
+    /**
+     * @return false if key was surely not added, always true for an empty filter
+     */
+    bool may_contain(const char *filter, size_t size, uint64_t key);
+
+}
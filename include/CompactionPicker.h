@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Version.h"
+#include "Options.h"
+
+/**
+ * Tables merged by one compaction, and the level the merged tables go to.
+ */
+struct Compaction {
+    size_t input_level = 0;
+    std::vector<table_ptr> inputs;      // from input_level, newest data first
+    size_t output_level = 0;            // may be one below the last level, created before merging
+    std::vector<table_ptr> overlapped;  // from output_level, older than all inputs
+    bool is_delete = false;             // no older data below: drop "~DELETED~" flags
+};
+
+/**
+ * Policy choosing what DiskRepo compacts next. Only called by the compaction
+ * thread with the repo mutex held, so a picker may keep state between calls.
+ */
+class CompactionPicker {
+public:
+    virtual ~CompactionPicker() = default;
+
+    /**
+     * Choose the next compaction of version, nothing is changed in it.
+     * @return false if no compaction is due
+     */
+    virtual bool pick(const Version &version, Compaction &compaction) = 0;
+
+    /**
+     * @return picker of options.compaction_style
+     */
+    static std::unique_ptr<CompactionPicker> create(const Options &options);
+
+protected:
+    /**
+     * @return true if level-0 holds more than 2 tables, which are then set as
+     *         inputs newest first (all of them are searched by each get)
+     */
+    static bool pick_level0(const Version &version, Compaction &compaction);
+};
+
+/**
+ * Leveled compaction: levels below level-0 hold tables with disjoint key ranges,
+ * level-0 is merged into level-1 at once, deeper levels give up one table a time
+ * to the next level once past their target bytes.
+ */
+class LeveledPicker : public CompactionPicker {
+private:
+    const size_t compaction_candidates;
+    const uint64_t level1_target_bytes;
+    const uint64_t level_size_multiplier;
+    const bool dynamic_level_bytes;
+    // per level (not level-0): key the next table to compact is searched from
+    std::vector<uint64_t> compact_cursors;
+
+    /**
+     * Bytes a level (not level-0) may hold before it overflows: level1_target_bytes
+     * times the multiplier per level below level-1, or with dynamic_level_bytes
+     * (above the bottom level) the bottom level's bytes divided by the multiplier
+     * per level above it, no less than level1_target_bytes.
+     */
+    uint64_t target_bytes(const Version &version, size_t index) const;
+
+    /**
+     * @return table count / 2 for level-0, bytes / target bytes for deeper levels
+     */
+    double level_score(const Version &version, size_t index) const;
+
+    /**
+     * Pick the one table of an overflowed level (not level-0) to compact next,
+     * and advance the level's cursor past it.
+     */
+    table_ptr pick_table(const Version &version, size_t index);
+
+public:
+    explicit LeveledPicker(const Options &options);
+
+    bool pick(const Version &version, Compaction &compaction) override;
+};
+
+/**
+ * Universal (size-tiered) compaction: level-0 tables are merged into a new sorted run
+ * of level-1 without touching older runs, and runs are merged together only once
+ * level-1 holds too many of them, preferring runs of similar size. Each byte is
+ * rewritten far less often than by leveled compaction, while a get may search
+ * every run. Runs are told apart by their time stamp, the newest run holds the newest
+ * data; levels below level-1 (left by leveled compaction) are kept as they are.
+ */
+class UniversalPicker : public CompactionPicker {
+private:
+    const size_t max_runs;
+    const uint64_t size_ratio;
+    const uint64_t max_size_amplification;
+
+public:
+    explicit UniversalPicker(const Options &options);
+
+    bool pick(const Version &version, Compaction &compaction) override;
+};
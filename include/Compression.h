@@ -0,0 +1,26 @@
+/**
+ * @brief Block compression of SSTables.
+ *        LZ is a byte-oriented LZ77 in the LZ4 block layout: sequences of
+ *        literals followed by a back-reference of 2-byte offset, ending in literals.
+ *        Fast to decode and needs no dictionary beyond the block itself.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace compression {
+
+    /**
+     * Append compressed form of n bytes at data to out.
+     */
+    void lz_compress(const char *data, size_t n, std::string &out);
+
+    /**
+     * Decompress n bytes at data into exactly out_size bytes at out.
+     * @return false if the input is corrupted or does not decode to out_size bytes
+     */
+    bool lz_decompress(const char *data, size_t n, char *out, size_t out_size);
+
+}
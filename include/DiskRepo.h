@@ -1,34 +1,100 @@
 #pragma once
 
-#include "Level.h"
+#include "Version.h"
+#include "CompactionPicker.h"
 #include "SkipList.h"
+#include "Options.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 class DiskRepo {
 
 private:
 
-    std::vector<Level*> disk_levels;
+    VersionSet versions;
 
     uint64_t time_stamp;
 
     const std::string dir;
 
-    void handle_overflow(size_t overflowed_index);
+    const size_t slowdown_trigger;
+    const size_t stop_trigger;
+
+    std::unique_ptr<BlockCache> block_cache;  // nullptr if disabled
+    // open files, read mode & metadata cache of all tables of this repository
+    const std::shared_ptr<TableCache> table_cache;
+
+    // format of flushed & merged tables
+    const TableOptions table_options;
+    // first level whose tables get an xor filter, 0 for none
+    const size_t xor_filter_level;
+    const size_t compaction_readahead;
+    const size_t max_subcompactions;
+    // chooses compactions by options.compaction_style, used by compaction_thread only
+    std::unique_ptr<CompactionPicker> picker;
+
+    // tables searched by gets, added once per get
+    std::atomic<uint64_t> table_probes;
+    // gets stopped by a table they could not read
+    std::atomic<uint64_t> read_errors;
+
+    // serializes Version installs & guards time_stamp, readers never take it
+    std::mutex repo_mutex;
+    std::condition_variable compaction_cv;  // compaction thread waits for work
+    std::condition_variable installed_cv;   // flushes wait for level-0 to shrink
+    bool compacting = false;
+    bool stopping = false;
+    // set once a compaction found a table corrupted, no more compactions are run then
+    bool compaction_failed = false;
+    // wait before the next compaction after one failed to write a table, 0 if it didn't
+    uint64_t compaction_retry_ms = 0;
+    std::thread compaction_thread;
 
-    bool check_overflow(size_t index);
+    /**
+     * Merge the tables of a picked compaction into its output level.
+     * Merging runs with repo_mutex released, then a Version with the merged
+     * tables in place of their inputs is installed. Tables are released from compaction.
+     * If an input can't be read to its end or a merged table can't be written, the
+     * merged tables are dropped and nothing is installed: the inputs stay where they
+     * are. A corrupted input sets compaction_failed, a failed write (e.g. a full disk)
+     * is retried after compaction_retry_ms, doubled on each failure in a row.
+     */
+    void run_compaction(std::unique_lock<std::mutex> &lock, Compaction &compaction);
 
-    void push_ssTable(SSTable *new_table);
+    /**
+     * Merge tables into dir, split on table boundaries into disjoint key ranges
+     * merged in parallel (subcompactions).
+     * @param prepared_data tables to be merged, newest data first
+     * @param merged set to the merged tables with the given time stamp, in key order
+     * @return status of the first failed range if any, merged is then left empty
+     */
+    Status merge_ranges(const std::vector<table_ptr> &prepared_data, bool is_delete,
+                        const std::string &dir, const TableOptions &options,
+                        uint64_t merge_ts, std::vector<SSTable*> &merged);
+
+    /**
+     * Body of compaction_thread.
+     */
+    void compaction_loop();
 
-    void push_ssTable(ListNode *head, uint64_t kv_count);
+    void push_ssTable(const table_ptr &new_table);
 
-    void create_level(uint64_t ls);
+    bool push_ssTable(SkipList *memTable);
+
+    /**
+     * Create directory of level ls and append the level to edit.
+     */
+    void create_level(Version &edit, uint64_t ls);
 
 public:
 
     /**
-     * Construct a level-structured disk repository for SSTables.
+     * Construct a level-structured disk repository for SSTables,
+     * and start its background compaction.
      */
-    explicit DiskRepo(const std::string& dir);
+    explicit DiskRepo(const std::string& dir, const Options &options = Options());
 
     /**
      * Destruct the disk repository (no file or directory deleted).
@@ -36,17 +102,50 @@ public:
     ~DiskRepo();
 
     /**
-     * Add a new SStable into repo, and handle possible overflow.
+     * Add a new SStable into level-0, and schedule compaction.
+     * Delayed or blocked while level-0 holds too many tables.
      * @param memTable SkipList storing data to be inserted.
+     * @return false if the SSTable could not be made durable, it is then left out
+     *         and the memTable's data must be kept elsewhere (in its logs)
      */
-    void push_table(SkipList *memTable);
+    bool push_table(SkipList *memTable);
 
     /**
     * Returns the (string) value of the given key in disk.
     * An empty string indicates not found.
+    * Searches the current Version without blocking flush or compaction.
     */
     std::string get(uint64_t key);
 
+    /**
+     * Find the value of key in disk without copying it when possible.
+     * @return NOT_FOUND if not found or deleted, CORRUPTION if a table that may hold
+     *         key can't be read (older data of key is not served instead), value is then reset
+     */
+    Status get(uint64_t key, PinnedValue &value);
+
+    /**
+     * @return block cache serving gets, nullptr if disabled
+     */
+    const BlockCache *get_block_cache() const;
+
+    /**
+     * @return number of SSTables searched by gets so far
+     */
+    uint64_t get_table_probes() const;
+
+    /**
+     * @return number of gets that found a table they had to search corrupted
+     */
+    uint64_t get_read_errors() const;
+
+    /**
+     * Append iterators over all SSTables of the current Version to iters,
+     * newest data first. Tables that surely hold no key of [start, end] are left out.
+     */
+    void add_iterators(std::vector<std::unique_ptr<Iterator>> &iters,
+                       uint64_t start = 0, uint64_t end = UINT64_MAX);
+
     /**
      * Delete all Levels and SSTables in the root directory.
      * Reset time_stamp to 1.
@@ -55,4 +154,3 @@ public:
 
     bool check_overlap();
 };
-
@@ -0,0 +1,62 @@
+/**
+ * @brief LRU cache of open SSTable file descriptors.
+ *        Reads use a positional read on a cached descriptor instead of
+ *        opening the file again. A descriptor evicted while in use
+ *        is closed when its last user releases it.
+ */
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "global.h"
+
+class FileCache {
+
+private:
+
+    struct File {
+        const int fd;
+        explicit File(int f): fd(f) {}
+        ~File();
+    };
+
+public:
+
+    typedef std::shared_ptr<const File> file_ptr;
+
+private:
+
+    std::mutex cache_mutex;
+
+    const size_t capacity;
+
+    std::list<std::pair<uint64_t, file_ptr>> lru;  // most recently used first
+
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, file_ptr>>::iterator> files;
+
+    /**
+     * Drop least recently used files beyond capacity. Caller holds cache_mutex.
+     */
+    void evict();
+
+public:
+
+    /**
+     * Construct an empty cache keeping at most capacity files open.
+     */
+    explicit FileCache(size_t capacity);
+
+    /**
+     * Get the open file of id, opening path read-only if not cached.
+     * @return nullptr if the file can't be opened
+     */
+    file_ptr open(uint64_t id, const std::string &path);
+
+    /**
+     * Forget file of id, called when the file is about to be deleted.
+     */
+    void erase(uint64_t id);
+};
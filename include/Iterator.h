@@ -0,0 +1,49 @@
+/**
+ * @brief Bidirectional cursor over the sorted key-value pairs of one source
+ *        (a memTable, an SSTable or a whole level).
+ *        Values may be "~DELETED~", hiding them is up to the caller.
+ */
+
+#pragma once
+
+#include "global.h"
+
+class Iterator {
+
+public:
+
+    virtual ~Iterator() = default;
+
+    virtual bool valid() const = 0;
+
+    virtual void seek_to_first() = 0;
+
+    virtual void seek_to_last() = 0;
+
+    /**
+     * Position at the first key >= key.
+     */
+    virtual void seek(uint64_t key) = 0;
+
+    /**
+     * Position at the last key <= key.
+     */
+    virtual void seek_for_prev(uint64_t key) = 0;
+
+    virtual void next() = 0;
+
+    virtual void prev() = 0;
+
+    virtual uint64_t key() const = 0;
+
+    /**
+     * @return current value, valid until the iterator moves
+     */
+    virtual Slice value() = 0;
+
+    /**
+     * @return CORRUPTION once the iterator met data it could not read, it may have
+     *         stopped early then; always OK for sources held in memory
+     */
+    virtual Status status() const { return Status::OK; }
+};
@@ -0,0 +1,64 @@
+/**
+ * @brief Iterator over live key-value pairs of a KVStore.
+ *        Merges memTables and all levels, the newest source of a key wins
+ *        and "~DELETED~" pairs are skipped. Values are read as the
+ *        iterator moves, never collected up front.
+ */
+
+#pragma once
+
+#include "SkipList.h"
+#include "MergingIterator.h"
+#include <memory>
+
+class KVIterator {
+
+private:
+
+    // kept alive for the iterators over them
+    std::vector<std::shared_ptr<SkipList>> mem_tables;
+
+    // sources newest first: memTables, then levels from level-0 down
+    std::unique_ptr<MergingIterator> merged;
+
+public:
+
+    /**
+     * Construct an unpositioned iterator over sources, newest first.
+     */
+    KVIterator(std::vector<std::shared_ptr<SkipList>> mem_tables,
+               std::vector<std::unique_ptr<Iterator>> sources);
+
+    bool valid() const;
+
+    void seek_to_first();
+
+    void seek_to_last();
+
+    /**
+     * Position at the first live key >= key.
+     */
+    void seek(uint64_t key);
+
+    /**
+     * Position at the last live key <= key.
+     */
+    void seek_for_prev(uint64_t key);
+
+    void next();
+
+    void prev();
+
+    uint64_t key() const;
+
+    /**
+     * @return current value, not copied: valid until the iterator moves
+     */
+    Slice value() const;
+
+    /**
+     * @return CORRUPTION once a table could not be read: the iterator became
+     *         invalid there, pairs past it are unknown
+     */
+    Status status() const;
+};
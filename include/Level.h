@@ -1,16 +1,71 @@
 #include "SSTable.h"
 #include <map>
+#include <memory>
 
+typedef std::shared_ptr<SSTable> table_ptr;
+
+/**
+ * SSTables of one level. A Level is copied into every new Version,
+ * its tables are shared between the copies.
+ */
 class Level {
 
 private:
 
-    std::map<key_type, SSTable*> level_tables;
+    std::map<key_type, table_ptr> level_tables;
+
+    // bytes of all tables before compression, the unit merged tables are cut in
+    uint64_t level_bytes;
 
     std::string level_path;
 
+    size_t level_number;
+
+    // not level-0: tables in key order & their max keys, so a get binary searches
+    // for the one table that may hold a key
+    std::vector<table_ptr> fence_tables;
+    KeyIndex fence_keys;
+    // false if tables overlap: sorted runs of universal compaction, or tables left by
+    // a compaction cut short by a crash. Gets then search tables newest first like in level-0
+    bool disjoint;
+
 public:
 
+    /**
+     * Iterator over a level whose tables don't overlap (not level-0),
+     * walking tables in key order and opening one at a time.
+     */
+    class Iterator : public ::Iterator {
+    private:
+        std::vector<table_ptr> tables;  // sorted by min_key
+        size_t table_index;
+        std::unique_ptr<SSTable::Iterator> table_itr;
+        // first error of a table no longer open
+        Status read_status = Status::OK;
+        void open_table(size_t index);
+        void skip_forward();
+        void skip_backward();
+    public:
+        /**
+         * Only tables that may hold keys of [start, end] are walked.
+         */
+        explicit Iterator(const Level &level, uint64_t start = 0, uint64_t end = UINT64_MAX);
+        bool valid() const override;
+        void seek_to_first() override;
+        void seek_to_last() override;
+        void seek(uint64_t key) override;
+        void seek_for_prev(uint64_t key) override;
+        void next() override;
+        void prev() override;
+        uint64_t key() const override;
+        Slice value() override;
+        /**
+         * @return first error of the tables walked, the iterator stops at a table
+         *         that could not be read instead of moving on to the next one
+         */
+        Status status() const override;
+    };
+
     /**
      * Construct a level from its directory and level-number.
      * Directory must exist before calling this function.
@@ -18,54 +73,95 @@ public:
     Level(const std::string& level_dir, size_t ls);
 
     /**
-     * Scan all existing SSTable in level directory.
+     * Scan all existing SSTable in level directory, level is finalized after.
      * Called just after construction.
+     * @param cache read state of the store the tables belong to
      * @return max time_stamp of SSTable in this Level
      */
-    uint64_t scan_level();
+    uint64_t scan_level(const std::shared_ptr<TableCache> &cache);
 
     /**
-     * Destruct a level, leaving its data on disk.
+     * Add a new SSTable into level, sorted by time stamp.
+     * Gets & iterators of the level see it only after finalize().
+     * @param new_ssTable constructed & saved new SSTable
      */
-    ~Level();
+    void push_back(const table_ptr &new_ssTable);
 
     /**
-     * Add a new SSTable into level, sorted by time stamp.
-     * @param new_ssTable constructed & saved new SSTable
+     * Rebuild fences (not level-0) once a batch of push_back / erase is done,
+     * before the level is searched or its Version installed.
      */
-    void push_back(SSTable *new_ssTable);
+    void finalize();
 
     /**
      * @return number of SSTables in the level
      */
-    size_t get_size();
+    size_t get_size() const;
+
+    /**
+     * @return bytes of all SSTables in the level before compression
+     */
+    uint64_t get_bytes() const;
+
+    /**
+     * Select k SSTables with smallest time_stamp & min_key, leaving them in level.
+     * @return vector of selected SSTables
+     */
+    std::vector<table_ptr> first_k(size_t k) const;
+
+    /**
+     * @return true if no two tables overlap (not level-0)
+     */
+    bool is_disjoint() const;
+
+    /**
+     * @return tables in key order (not level-0)
+     */
+    const std::vector<table_ptr> &sorted_tables() const;
+
+    /**
+     * @return tables holding keys within scope, in key order if the level is disjoint,
+     *         newest first otherwise
+     */
+    std::vector<table_ptr> overlapping(scope_type scope) const;
+
+    /**
+     * Remove given SSTables from level (no file deleted), seen after finalize().
+     */
+    void erase(const std::vector<table_ptr> &tables);
 
     /**
-     * Pop out k SSTables with smallest time_stamp & min_key.
-     * @return vector of popped SSTables
+     * Search a value (include "~DELETED~") by its key, newest table first in level-0.
+     * @param probes increased by the number of tables searched
+     * @return OK if found (value is then set), CORRUPTION if a table that
+     *         may hold key can't be read, older tables are then left unsearched
      */
-    std::vector<SSTable*> pop_k(size_t k);
+    Status get(uint64_t key, PinnedValue &value, BlockCache *cache, size_t &probes) const;
 
     /**
-     * Search a string (include "~DELETED~") by its key.
-     * ret_ts would be set to time_stamp of SSTable containing this kv-pair.
+     * Append iterators covering this level to iters, newest data first:
+     * one per SSTable in level-0 or a level whose tables overlap, a single Level::Iterator otherwise.
+     * Tables that surely hold no key of [start, end] are left out,
+     * the iterators are then only meant for keys in that range.
      */
-    std::string get(uint64_t key, uint64_t &ret_ts);
+    void add_iterators(std::vector<std::unique_ptr<::Iterator>> &iters,
+                       uint64_t start = 0, uint64_t end = UINT64_MAX) const;
 
     /**
-     * Delete directory linked with this Level.
+     * Mark all SSTables obsolete and remove them from level,
+     * their files are deleted once no Version holds them.
      */
     void delete_level();
 
     /**
      * @return Linked directory path of this Level.
      */
-    std::string get_level_path();
+    std::string get_level_path() const;
 
     /**
      * @return pointer to storage map of Level
      */
-    std::map<key_type, SSTable*> *get_level();
+    const std::map<key_type, table_ptr> *get_level() const;
 
-    bool check_overlap();
+    bool check_overlap() const;
 };
\ No newline at end of file
@@ -2,35 +2,36 @@
 
 #include "global.h"
 
+/**
+ * Output of a merge waiting to be written as one SSTable.
+ * Keys & value offsets are kept in arrays and values back to back in one string,
+ * so appending a pair allocates nothing once the buffer has grown.
+ */
 class MergeBuffer {
 private:
 
-    ListNode *head, *rear;
-    uint64_t data_count = 0;  // number of data in buffer
-    uint64_t data_total_length = 0; // total length of all strings
-
-    void delete_all();
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> offsets;  // start of each value in values
+    std::string values;
 
 public:
     // Construct an empty buffer.
-    MergeBuffer();
-
-    // Destruct a MergeBuffer, delete all nodes included.
-    ~MergeBuffer();
+    MergeBuffer() = default;
 
-    // Add a key-value pair to buffer with sorted sequence.
-    bool push_back(uint64_t key, const std::string& value);
+    // Add a key-value pair to buffer with sorted sequence, false if the table would be full.
+    // An empty buffer takes any pair.
+    bool push_back(uint64_t key, Slice value);
 
-    // Head pointer of linked list.
-    ListNode *get_head();
+    // Key of the i-th pair.
+    uint64_t key(size_t i) const;
 
-    // Rear pointer of linked list.
-    ListNode *get_rear();
+    // Value of the i-th pair, valid till the buffer changes.
+    Slice value(size_t i) const;
 
-    // Number of kv-pair stored in linked list.
+    // Number of kv-pair stored in buffer.
     uint64_t get_size() const;
 
-    // Clear the buffer.
+    // Clear the buffer, keeping its memory.
     void clear();
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,119 @@
+/**
+ * @brief Merge of sorted sources given newest first (memTables, SSTables or levels),
+ *        walking each key once with the value of its newest source.
+ *        Sources are picked by a loser tree: a move replays one leaf-to-root
+ *        path of log k comparisons, without copying entries around.
+ *        Read by KVIterator and by compactions.
+ */
+
+#pragma once
+
+#include "Iterator.h"
+#include <memory>
+#include <vector>
+
+class MergingIterator : public Iterator {
+
+private:
+
+    std::vector<std::unique_ptr<Iterator>> sources;
+    // cached state of each source, so matches don't call into it
+    struct Head {
+        bool valid;
+        uint64_t key;  // valid only if the source is
+    };
+    std::vector<Head> heads;
+    // loser tree over sources: tree[0] is the winner, tree[1..k) the loser of each match,
+    // source i at leaf k + i. Rebuilt whenever all sources are moved at once.
+    std::vector<size_t> tree;
+
+    // "~DELETED~" keys are skipped, older versions of them included
+    const bool skip_deleted;
+    // keys outside [first_key, last_key] are left out
+    const uint64_t first_key, last_key;
+
+    // forward: all valid sources are at keys >= cur_key, backward: at keys <= cur_key
+    bool forward = true;
+
+    bool is_valid = false;
+    uint64_t cur_key = 0;
+    // points into the winning source, valid until it moves
+    Slice cur_value;
+    // first error of a source, the iterator stays invalid after it
+    Status read_status = Status::OK;
+
+    /**
+     * Cache the position of source and record its error if it has one.
+     */
+    void load(size_t source);
+
+    /**
+     * Order of sources in the current direction: nearer key, then newer source;
+     * exhausted ones last.
+     */
+    bool before(size_t a, size_t b) const;
+
+    /**
+     * Fill the matches below node.
+     * @return winner of the subtree
+     */
+    size_t build(size_t node);
+
+    /**
+     * Load all sources and rebuild the tree, after they all moved.
+     */
+    void rebuild();
+
+    /**
+     * Move source one step in the current direction and replay its matches to the root.
+     */
+    void step(size_t source);
+
+    /**
+     * Move all sources at cur_key past it.
+     */
+    void skip_key();
+
+    /**
+     * Settle on the nearest key of sources in the current direction (not deleted if
+     * skip_deleted), or become invalid past the range or at the first error of a source.
+     */
+    void find_live();
+
+public:
+
+    /**
+     * Construct an unpositioned iterator over sources, newest first.
+     * @param skip_deleted hide "~DELETED~" keys, else they are walked like any value
+     * @param start, end only keys with start <= key <= end are walked
+     */
+    MergingIterator(std::vector<std::unique_ptr<Iterator>> sources, bool skip_deleted,
+                    uint64_t start = 0, uint64_t end = UINT64_MAX);
+
+    bool valid() const override;
+
+    void seek_to_first() override;
+
+    void seek_to_last() override;
+
+    void seek(uint64_t key) override;
+
+    void seek_for_prev(uint64_t key) override;
+
+    void next() override;
+
+    void prev() override;
+
+    uint64_t key() const override;
+
+    /**
+     * @return current value, not copied: valid until the iterator moves
+     */
+    Slice value() override;
+
+    /**
+     * @return CORRUPTION once a source could not be read: the iterator became
+     *         invalid there, pairs past it are unknown
+     */
+    Status status() const override;
+};
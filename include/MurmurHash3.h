@@ -32,9 +32,14 @@ inline uint64_t rotl64 ( uint64_t x, int8_t r )
 
 #endif // !defined(_MSC_VER)
 
+#include <string.h>
+
+// memcpy instead of dereferencing, key & out may be of any type
 FORCE_INLINE uint64_t getblock64 ( const uint64_t * p, int i )
 {
-  return p[i];
+  uint64_t block;
+  memcpy(&block, p + i, sizeof(block));
+  return block;
 }
 
 FORCE_INLINE uint64_t fmix64 ( uint64_t k )
@@ -126,6 +131,6 @@ void MurmurHash3_x64_128 ( const void * key, const int len,
   h1 += h2;
   h2 += h1;
 
-  ((uint64_t*)out)[0] = h1;
-  ((uint64_t*)out)[1] = h2;
+  memcpy(out, &h1, sizeof(h1));
+  memcpy((uint8_t*)out + sizeof(h1), &h2, sizeof(h2));
 }
\ No newline at end of file
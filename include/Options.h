@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+
+/* ----- When appended WAL records are forced to stable storage ----- */
+enum class SyncMode {
+    EVERY_WRITE,   // fsync once per put / del
+    GROUP_COMMIT,  // fsync once per batch of puts / dels of concurrent writers, formed by the writer queue
+    PERIODIC       // fsync by a background thread every sync_interval_ms
+};
+
+/* ----- How SSTable data blocks are compressed (values are stored on disk) ----- */
+enum class Compression : uint8_t {
+    NONE = 0,  // blocks stored as is
+    LZ = 1     // bundled LZ4-style codec, kept only if it saves 1/8 of a block
+};
+
+/* ----- How tables below level-0 are organized & compacted ----- */
+enum class CompactionStyle {
+    LEVELED,   // disjoint tables per level, each level some times bigger than the one above
+    UNIVERSAL  // sorted runs in level-1 merged when similar in size: less writing, slower gets
+};
+
+/**
+ * Tunable parameters of a KVStore, fixed at construction.
+ * Default-constructed Options reproduce the behaviour of KVStore(dir).
+ */
+struct Options {
+
+    /* ----- Write-ahead log ----- */
+    SyncMode sync_mode = SyncMode::GROUP_COMMIT;
+    uint64_t sync_interval_ms = 100;
+
+    /* ----- MemTable ----- */
+    // full memTables allowed to wait for the flush thread before writers block
+    size_t max_immutable_memtables = 2;
+    // queued puts / dels applied to memTable by one writer in a single pass
+    size_t max_write_batch = 128;
+
+    /* ----- Read path ----- */
+    // bytes of SSTable values cached for gets, 0 disables the cache
+    size_t block_cache_capacity = 8 << 20;
+    // SSTable files kept open
+    size_t max_open_files = 256;
+    // read SSTables through a memory mapping instead of pread and the block cache
+    bool mmap_reads = false;
+    // bytes of index partitions & bloom filters of tables with a partitioned index held in memory
+    size_t table_metadata_capacity = 4 << 20;
+
+    /* ----- Table format ----- */
+    // format of new SSTables: 2 for data blocks with a sparse index,
+    // 1 for the legacy dense-index layout. Tables of both formats are always readable.
+    uint32_t table_format_version = 2;
+    // data block size before compression, format 2 only
+    size_t table_block_size = 4096;
+    Compression table_compression = Compression::LZ;
+    // format 2 only: store the block index in partitions of about index_partition_size bytes.
+    // Only an index of partitions stays in memory, partitions and the bloom filter
+    // are read on demand through the table metadata cache.
+    bool partition_index = false;
+    size_t index_partition_size = 4096;
+    // bloom filter of format 2 tables, 0 writes no filter
+    size_t filter_bits_per_key = 10;
+    // tables merged into this level or deeper get an xor filter instead of the bloom filter:
+    // about 9.8 bits per key, close to the default bloom filter, for fewer false positives
+    // (about 0.4% instead of 1%), built from all keys of a table at once.
+    // 0 keeps bloom filters on every level.
+    size_t xor_filter_level = 0;
+    // format 2 only: bloom filter over key prefixes (key >> range_filter_shift), so scans of
+    // narrow ranges skip tables holding no key of the range. 0 bits per prefix writes none.
+    size_t range_filter_bits_per_prefix = 0;
+    size_t range_filter_shift = 6;
+
+    /* ----- Compaction ----- */
+    CompactionStyle compaction_style = CompactionStyle::LEVELED;
+    // bytes read at once from each table being merged (pread mode), split among subcompactions
+    size_t compaction_readahead = 1 << 20;
+    // a compaction is split into at most this many key ranges merged on their own threads,
+    // each range taking two input tables or more
+    size_t max_subcompactions = 4;
+    // leveled only: tables above level-0 are compacted one at a time: of this many tables following
+    // the level's round-robin cursor, the one overlapping fewest bytes of the next level
+    size_t compaction_candidates = 4;
+    // leveled only: bytes level-1 holds before it overflows, counted before compression like
+    // merged tables are cut, level_size_multiplier times more on each deeper level
+    // (level-0 overflows above 2 tables)
+    uint64_t level1_target_bytes = 8 << 20;
+    uint64_t level_size_multiplier = 10;
+    // leveled only: size the levels above the bottom one from the bytes it actually holds, so upper levels
+    // keep about 1 / (multiplier - 1) of the data: space amplification stays bounded
+    // while the bottom level is still filling up
+    bool dynamic_level_bytes = true;
+    // universal only: sorted runs level-1 holds before some are merged
+    size_t universal_max_runs = 4;
+    // universal only: starting from the newest run, an older run is merged along
+    // if at most this percent bigger than the newer runs together
+    uint64_t universal_size_ratio = 1;
+    // universal only: all runs are merged once the newer runs together reach
+    // this percent of the oldest run's bytes
+    uint64_t universal_max_size_amplification = 200;
+    // level-0 table count at which each flush is delayed by 1ms
+    size_t level0_slowdown_trigger = 8;
+    // level-0 table count at which flushes wait for compaction
+    size_t level0_stop_trigger = 12;
+};
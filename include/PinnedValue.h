@@ -0,0 +1,70 @@
+/**
+ * @brief Value handed out by KVStore::get without copying it.
+ *        Points into a memTable, a cached block or a mapped file and
+ *        keeps that memory alive until reset or destroyed. Values with
+ *        no such backing are copied once into a buffer of its own.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include "global.h"
+
+class PinnedValue {
+private:
+    Slice slice;
+
+    // keeps pinned data alive, null if the value is owned or empty
+    std::shared_ptr<const void> owner;
+
+    // data of an owned value, its capacity is reused by later gets
+    std::string buffer;
+
+    bool owned;
+
+public:
+    PinnedValue();
+
+    PinnedValue(PinnedValue &&other) noexcept;
+    PinnedValue &operator=(PinnedValue &&other) noexcept;
+    PinnedValue(const PinnedValue&) = delete;
+    PinnedValue &operator=(const PinnedValue&) = delete;
+
+    /**
+     * Point to data without copying it.
+     * @param data bytes of the value
+     * @param owner anything whose lifetime covers data
+     */
+    void pin(Slice data, std::shared_ptr<const void> owner);
+
+    /**
+     * Switch to an owned value of given size.
+     * @return buffer of size bytes to be filled by the caller
+     */
+    char *own(size_t size);
+
+    /**
+     * Drop the value and release whatever was pinned.
+     */
+    void reset();
+
+    /**
+     * @return current value, valid until this PinnedValue is reset, reassigned or destroyed
+     */
+    Slice value() const;
+    const char *data() const;
+    size_t size() const;
+
+    /**
+     * @return true if the value points into memory shared with the store
+     */
+    bool is_pinned() const;
+
+    std::string to_string() const;
+
+    /**
+     * Move the value out, without copying if it is owned. Leaves this PinnedValue empty.
+     */
+    std::string release();
+};
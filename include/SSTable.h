@@ -1,133 +1,512 @@
 #pragma once
 
-#include <bitset>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include "MergeBuffer.h"
+#include "SkipList.h"
+#include "BlockCache.h"
+#include "TableCache.h"
+#include "PinnedValue.h"
+#include "Options.h"
+#include "KeyIndex.h"
+#include "BloomFilter.h"
+#include "XorFilter.h"
 
-class SSTable {
+/**
+ * Layout of SSTables being written, taken from Options.
+ * Tables read back from disk carry their own format.
+ */
+struct TableOptions {
+    uint32_t format_version;
+    size_t block_size;
+    Compression compression;
+    bool partition_index;
+    size_t index_partition_size;
+    size_t filter_bits_per_key;
+    // xor filter instead of bloom filter, set per output level by DiskRepo
+    bool xor_filter;
+    size_t range_filter_bits_per_prefix;
+    size_t range_filter_shift;
+    explicit TableOptions(const Options &options = Options());
+};
+
+/**
+ * Sorted table of key-value pairs stored in one file, in one of two formats.
+ *
+ * Format 1 (legacy), loads the whole index into memory:
+ * | header (32) | bloom filter | key (8) offset (4) per pair | values |
+ *
+ * Format 2, keeps one index entry per data block in memory:
+ * | TABLE_MAGIC (8) | version (4) | flags (4) | header (32) | filter size (8) | bloom filter |
+ * | data blocks | block index | index offset (8) | block count (8) | TABLE_MAGIC (8) |
+ * data block: | contents, or raw size (4) + LZ of contents | compression (1) | crc32 (4) |
+ * contents:   | key (8) value length (4) value, per pair | entry offset (4) per pair | pair count (4) |
+ * index entry: | last key (8) | block offset (8) | stored size with trailer (4) | pair count (4) |
+ * The filter is a split-block bloom filter (BLOCKED_FILTER in flags) or an xor filter (XOR_FILTER).
+ * Without either (written by earlier builds) the filter size is absent,
+ * and the filter is the FILTER_BYTE_SIZE one of format 1.
+ * With RANGE_FILTER in flags, a split-block bloom filter of key prefixes follows the filter:
+ * | ... bloom filter | prefix shift (8) | range filter size (8) | range filter | data blocks ...
+ * With VALUE_BYTES in flags, bytes of all values before compression follow the filters:
+ * | ... bloom filter (and range filter) | value bytes (8) | data blocks ...
+ *
+ * With PARTITIONED_INDEX in flags, the block index is split into partitions and
+ * only an index of partitions (and no bloom filter) stays in memory:
+ * | ... data blocks | index entries of partition, per partition | partition index |
+ * | index offset (8) | partition count (8) | TABLE_MAGIC (8) |
+ * partition index entry: | last key (8) | partition offset (8) | size (4) | block count (4) | pair count (8) |
+ */
+class SSTable : public std::enable_shared_from_this<SSTable> {
 private:
 
+    // begins format 2 files, a legacy time stamp never reaches its top bit
+    static const uint64_t TABLE_MAGIC = 0xB10C7AB1E5570002ULL;
+    static const uint32_t LEGACY_FORMAT = 1;
+    static const uint32_t BLOCK_FORMAT = 2;
+    static const size_t LEGACY_HEADER_SIZE = 32;
+    static const size_t BLOCK_HEADER_SIZE = 16 + LEGACY_HEADER_SIZE;
+    static const size_t BLOCK_TRAILER_SIZE = 5;
+    static const size_t FOOTER_SIZE = 24;
+    static const size_t INDEX_ENTRY_SIZE = 24;
+    static const size_t PARTITION_ENTRY_SIZE = 32;
+    static const uint32_t PARTITIONED_INDEX = 1;
+    static const uint32_t BLOCKED_FILTER = 2;
+    static const uint32_t XOR_FILTER = 4;
+    // filters stored with their size
+    static const uint32_t SIZED_FILTER = BLOCKED_FILTER | XOR_FILTER;
+    static const uint32_t RANGE_FILTER = 8;
+    static const uint32_t VALUE_BYTES = 16;
+    // prefixes probed by range_test at most, wider ranges are never ruled out
+    static const uint64_t RANGE_FILTER_PROBES = 16;
+
     std::string file_path;
 
+    // set once no newer Version refers to this table
+    std::atomic<bool> obsolete;
+    // table whose file may only be deleted after this one's, see mark_obsolete
+    std::shared_ptr<SSTable> delete_before;
+
+    // false if the file could not be written, synced or given its name
+    bool durable;
+
+    // unique among SSTable objects of the process, names the table in BlockCache
+    const uint64_t cache_id;
+    static std::atomic<uint64_t> next_cache_id;
+
+    // open files, read mode & metadata cache of the store holding this table
+    const std::shared_ptr<TableCache> table_cache;
+
+    // start & length of values (legacy) or data blocks
     uint64_t header_offset;
     uint64_t string_length;
+    // bytes of all values as written by put, string_length for tables stored without them
+    uint64_t value_bytes;
+    // end of data blocks & index partitions, where the in-memory index is read from
+    uint64_t index_offset;
+
+    // whole linked file, mapped by the first read if table_cache->mmap_reads
+    std::once_flag map_once;
+    const char *mapped_file;
+    size_t mapped_size;
 
     struct Header {
+        // stored in this order by both formats
         uint64_t time_stamp;
         uint64_t kv_count;
         uint64_t min_key, max_key;
+        // stored before the rest by format 2 only
+        uint32_t version;
+        uint32_t flags;
         Header();
-        Header(uint64_t ts, uint64_t kc, uint64_t min, uint64_t max);
+        Header(uint64_t ts, uint64_t kc, uint64_t min, uint64_t max, uint32_t v, uint32_t f);
     } table_header;
 
-    std::bitset<FILTER_BIT_SIZE> bloom_filter;
-    void bitset_to_bytes(char*);
-    void bitset_from_bytes(const char*);
+    // split-block bloom filter if BLOCKED_FILTER is set, xor filter if XOR_FILTER is set,
+    // else the fixed-size bloom filter of format 1.
+    // Empty if the index is partitioned (the filter is then read through table_cache->metadata)
+    // or the filter can't rule keys out.
+    std::string filter;
+    uint64_t filter_offset;
+    uint64_t filter_size;
+    /**
+     * @return false if key is surely not in the table, given bytes of its filter
+     */
+    bool filter_test(const char *bytes, size_t size, uint64_t key) const;
     bool bloom_test(uint64_t);
-    
-    struct IndexData {
-        uint64_t key;
-        uint32_t offset;
-        IndexData();
-        IndexData(uint64_t k, uint32_t o);
-    } *data_index;
+
+    // bloom filter of key >> range_shift, if RANGE_FILTER is set.
+    // Empty if the index is partitioned, read through table_cache->metadata like filter.
+    std::string range_filter;
+    uint64_t range_shift;
+    uint64_t range_offset;
+    uint64_t range_size;
+
+    // legacy format only: key & offset of value of each pair, empty otherwise
+    KeyIndex index_keys;
+    std::vector<uint32_t> value_offsets;
+
+    struct BlockHandle {
+        uint64_t last_key;
+        uint64_t offset;
+        uint32_t size;
+        uint32_t count;
+        uint64_t first_index;  // index of its first pair in the table, not stored
+    };
+    // format 2 only, one entry per data block, empty if the index is partitioned
+    std::vector<BlockHandle> block_index;
+    KeyIndex block_keys;  // last keys of block_index
+
+    struct PartitionHandle {
+        uint64_t last_key;
+        uint64_t offset;
+        uint32_t size;
+        uint32_t block_count;
+        uint64_t pair_count;
+        uint64_t first_block, first_index;  // not stored
+    };
+    // one entry per index partition, empty unless the index is partitioned
+    std::vector<PartitionHandle> partition_index;
+    KeyIndex partition_keys;  // last keys of partition_index
+
+    // data blocks of a format 2 table
+    uint64_t block_count;
+
+    /**
+     * Build block_keys or partition_keys from the loaded index.
+     */
+    void index_last_keys();
+
+    /**
+     * Decoded contents of a data block, kept alive by owner.
+     */
+    struct Block {
+        Slice data;
+        std::shared_ptr<const void> owner;
+        uint32_t count;
+        Block();
+        Block(Slice data, std::shared_ptr<const void> owner);
+        uint64_t key(uint32_t i) const;
+        Slice value(uint32_t i) const;
+        /**
+         * @return position of first key >= key, count if none
+         */
+        uint32_t lower_bound(uint64_t key) const;
+    private:
+        const char *entry(uint32_t i) const;
+    };
+
+    /**
+     * Read size bytes of metadata at offset, pinned in the mapping
+     * or cached in table_cache->metadata as the given piece of this table.
+     * @return the bytes kept alive by owner, empty if they can't be read
+     */
+    Slice load_metadata(uint64_t piece, uint64_t offset, size_t size, std::shared_ptr<const void> &owner);
+
+    /**
+     * Fill handle with entry i of a partition of the block index,
+     * pairs of the partition starting at first_index.
+     */
+    static void decode_handle(Slice partition, size_t i, uint64_t first_index, BlockHandle &handle);
+
+    // returned by find_block & block_of when an index partition can't be read
+    static const size_t BROKEN_INDEX = SIZE_MAX;
+
+    /**
+     * @param handle set to handle of the found block
+     * @return first block whose last key >= key, block_count if none
+     */
+    size_t find_block(uint64_t key, BlockHandle &handle);
+
+    /**
+     * @param handle set to handle of the found block
+     * @return block holding pair with given index
+     */
+    size_t block_of(uint64_t index, BlockHandle &handle);
+
+    /**
+     * Read, verify and decompress a data block. Uncompressed blocks of a
+     * mapped file are pinned in the mapping, others go through cache if given.
+     * @param found set to the decoded block
+     * @param stored bytes of the block already read from the file, nullptr to read them here
+     * @return CORRUPTION if the block can't be read, or its checksum or compression is broken
+     */
+    Status load_block(size_t block, const BlockHandle &handle, BlockCache *cache, Block &found,
+                      const char *stored = nullptr);
+
+    /**
+     * Read n bytes at offset of linked file through table_cache->files.
+     * @return false if the file can't be read
+     */
+    bool read_at(uint64_t offset, char *buf, size_t n);
+
+    /**
+     * Map linked file on first call, advised for random reads.
+     * @return start of mapping, nullptr if table_cache->mmap_reads is off or mapping failed
+     */
+    const char *mapping();
+
+    /**
+     * @return byte length of value with given index, legacy format only
+     */
+    size_t value_length(uint64_t index) const;
+
+    /**
+     * Find 4KB window of the value area in cache, reading it from linked file if missed.
+     * Legacy format only, format 2 caches whole data blocks instead.
+     * @return nullptr if the window can't be read, nothing is cached then
+     */
+    BlockCache::block_ptr read_window(uint64_t window, BlockCache &cache);
+
+    /**
+     * Read value at offset of the value area through cache.
+     * A value inside one window is pinned there, otherwise copied once.
+     * @return CORRUPTION if a window of the value can't be read
+     */
+    Status read_cached(size_t offset, size_t length, PinnedValue &value, BlockCache &cache);
+
     /**
-     * binary search in data_index for key
-     * @param key query key
-     * @return The index corresponding to the key (kv_count if not found)
+     * Generate index & bloom filter from sorted data, and write SSTable to dir.
+     * Cursor walks kv_count pairs by valid() / next() / key() / value().
      */
-    size_t binary_search(uint64_t);
+    template<typename Cursor>
+    void build(Cursor data, uint64_t kv_count, uint64_t time_stamp, const std::string &dir,
+               const TableOptions &options);
+
+    /**
+     * Write data blocks, block index (partitioned if asked) & footer
+     * of a format 2 table after its header.
+     */
+    template<typename Cursor>
+    void write_blocks(Cursor data, std::ofstream &out, const TableOptions &options);
+
+    /**
+     * Append contents as a data block, compressed if worthwhile.
+     * contents is left holding the stored block.
+     */
+    void write_block(std::ofstream &out, std::string &contents, uint64_t last_key,
+                     uint32_t count, const TableOptions &options);
 
 public:
+    /**
+     * Iterator over key-value pairs of a table, keeping the table
+     * (and its file) alive.
+     */
+    class Iterator : public ::Iterator {
+    private:
+        std::shared_ptr<SSTable> table;
+        uint64_t index;  // kv_count if not valid
+        std::string buffer;  // legacy format only, unused when the table is mapped
+        // format 2 only: block holding index, block_count if none loaded
+        size_t block_number;
+        BlockHandle handle;
+        Block block;
+        // bytes read ahead of the position by one large read, pread mode only
+        size_t readahead;
+        std::string window;
+        uint64_t window_offset;
+        /**
+         * Bytes at offset of the data area through the read-ahead window,
+         * refilled from offset when they lie outside it.
+         * @return nullptr if read-ahead is off or the bytes can't be read
+         */
+        const char *read_ahead(uint64_t offset, size_t size);
+        // CORRUPTION once a block or value could not be read
+        Status read_status;
+        /**
+         * Load block with given number and handle.
+         * @return false if the block is broken
+         */
+        bool load(size_t number, const BlockHandle &handle);
+        /**
+         * Become invalid, recording a broken block unless found is block_count.
+         */
+        void stop(size_t found);
+        /**
+         * Load the block holding index if another one is loaded,
+         * stop (become invalid) at a broken block.
+         */
+        void settle();
+    public:
+        explicit Iterator(std::shared_ptr<SSTable> table);
+        /**
+         * Read the file in chunks of bytes instead of one block / value at a time,
+         * for iterators walking a whole table. Unused when the table is mapped.
+         */
+        void set_readahead(size_t bytes);
+        /**
+         * @return CORRUPTION if the iterator stopped at data it could not read,
+         *         so it became invalid before the end of the table
+         */
+        Status status() const override;
+        bool valid() const override;
+        void seek_to_first() override;
+        void seek_to_last() override;
+        void seek(uint64_t key) override;
+        void seek_for_prev(uint64_t key) override;
+        void next() override;
+        void prev() override;
+        uint64_t key() const override;
+        /**
+         * @return current value, pointing into the mapping if the table is mapped
+         *         (valid while the iterator exists), otherwise valid till the next move
+         */
+        Slice value() override;
+    };
+
     /*
      * Unique SSTable ID, start with 0.
+     * Taken by flush and compaction threads at the same time.
      */
-    static uint64_t table_id;
+    static std::atomic<uint64_t> table_id;
 
     /**
      * Constructor for SSTable, writing SSTable to level-0 immediately.
      * @param data value vector for all key-value pairs
      * @param time_stamp current SSTable's time stamp
      * @param dir data dictionary of this LSM tree
+     * @param options format of the written file
+     * @param cache read state of the store, nullptr for TableCache::standalone()
+     */
+    SSTable(std::vector<value_type> *data, uint64_t time_stamp, const std::string &dir,
+            const TableOptions &options = TableOptions(), std::shared_ptr<TableCache> cache = nullptr);
+
+    /**
+     * Constructor for SSTable from merged pairs, writing SSTable to dir immediately.
+     * @param buffer pairs of the table, sorted by key
+     * @param time_stamp current SSTable's time stamp
+     * @param dir data dictionary of this LSM tree
+     * @param options format of the written file
+     * @param cache read state of the store, nullptr for TableCache::standalone()
      */
-    SSTable(std::vector<value_type> *data, uint64_t time_stamp, const std::string &dir);
+    SSTable(const MergeBuffer &buffer, uint64_t time_stamp, const std::string &dir,
+            const TableOptions &options = TableOptions(), std::shared_ptr<TableCache> cache = nullptr);
 
     /**
-     * Faster & lower memory cost Constructor for SSTable, the low coupling degree is lost.
-     * Also writing SSTable to level-0 immediately.
-     * @param data_head head node of the lowest level in SkipList, which contains all key-value pairs
+     * Constructor for SSTable from a full memTable, writing SSTable to dir immediately.
+     * @param mem_table memTable no longer written to
      * @param time_stamp current SSTable's time stamp
      * @param dir data dictionary of this LSM tree
+     * @param options format of the written file
+     * @param cache read state of the store, nullptr for TableCache::standalone()
      */
-    SSTable(ListNode *data_head, uint64_t kv_count, uint64_t time_stamp, const std::string &dir);
+    SSTable(const SkipList &mem_table, uint64_t time_stamp, const std::string &dir,
+            const TableOptions &options = TableOptions(), std::shared_ptr<TableCache> cache = nullptr);
 
     /**
-     * Constructor for SSTable from disk, only used when rebuilding LSM tree from dir.
+     * Constructor for SSTable from disk (of either format), only used when rebuilding LSM tree from dir.
+     * @param cache read state of the store, nullptr for TableCache::standalone()
      */
-    explicit SSTable(const std::string &file_path);
+    explicit SSTable(const std::string &file_path, std::shared_ptr<TableCache> cache = nullptr);
     /**
-     * Destructor, does not delete SSTable file for persistence.
+     * Destructor, does not delete SSTable file for persistence,
+     * unless the table has been marked obsolete.
      */
     ~SSTable();
 
     /**
-     * Save SSTable in defined structure.
+     * Save header, bloom filter and (legacy format) index of SSTable.
      * @param ssTable_in_file oftream to stored SSTable
      */
     void write_header(std::ofstream &ssTable_in_file);
 
     /**
      * Find data with given index, use this function to get single data.
-     * @param index data index 
-     * @return current queried string ("" if index >= size)
+     * @param index data index
+     * @return current queried string ("" if index >= size or the value can't be read)
      */
     std::string get_by_index(uint64_t index);
 
     /**
      * Merge several SSTables and write them to Disk at the same time.
-     * @param prepared_data SSTables to be merged
-     * @param time_stamp current time stamp to initialise new SSTable
+     * Old SSTables are left untouched, the caller deletes them once replaced.
+     * @param prepared_data SSTables to be merged, newest data first
      * @param is_delete if true, delete all data with "~DELETED~" flag
      * @param dir target write dictionary
-     * @return merged SSTables
+     * @param options format of the merged tables
+     * @param time_stamp time stamp of the merged tables
+     * @param readahead bytes read at once from each input table
+     * @param start, end only pairs with start <= key <= end are merged
+     * @param cache read state of the store the merged tables belong to
+     * @param merged set to the merged SSTables, in key order
+     * @return CORRUPTION if an SSTable could not be read to its end, IO_ERROR if a merged
+     *         one could not be made durable, merged is then left empty and the files written deleted
      */
-    friend std::vector<SSTable*> merge_table(std::vector<SSTable*> &prepared_data, bool is_delete, const std::string &dir);
+    friend Status merge_table(const std::vector<std::shared_ptr<SSTable>> &prepared_data,
+                              bool is_delete, const std::string &dir,
+                              const TableOptions &options, uint64_t time_stamp,
+                              size_t readahead, uint64_t start, uint64_t end,
+                              const std::shared_ptr<TableCache> &cache, std::vector<SSTable*> &merged);
 
     /**
      * @return pair of (min_key, max_keu), which indicates range of data in this SSTable.
      */
     scope_type get_scope();
 
+    /**
+     * @return bytes of data blocks (or values of format 1) stored in the file
+     */
+    uint64_t get_data_size() const;
+
+    /**
+     * @return bytes the pairs take before compression, counted like MergeBuffer
+     *         counts them when it cuts merged tables
+     */
+    uint64_t get_raw_size() const;
+
     /**
      * @return time stamp of current SSTable
      */
     uint64_t get_time_stamp() const;
 
     /**
-     * open the SSTable file to prepare for reading data continuously
-     * @return quote to ifstream of SSTable, set flag position to the beginning of data area
+     * @return format version of the linked file
      */
-    std::ifstream *open_file();
+    uint32_t get_format_version() const;
 
     /**
-     * read data with given ifstream and index, use this function to read data continuously
-     * @param fs quote to ifstream of SSTable, flag set to the beginning of current data
-     * @param index data index
-     * @return current queried string ("" if index >= size)
+     * @return true if only an index of block index partitions is kept in memory
      */
-    std::string read_by_index(std::ifstream &fs, uint64_t index);
+    bool is_partitioned() const;
 
     /**
-     * Get string by key (if any).
-     * Bloom test -> binary search -> read from linked file.
+     * Check scope & range filter, without reading data blocks.
+     * @return false if no key of [start, end] is surely in the table
+     */
+    bool range_test(uint64_t start, uint64_t end);
+
+    /**
+     * Get value by key (if any), only for tables owned by a shared_ptr.
+     * Bloom test -> index search -> pin in mapping or cache, or read linked file.
      * @param key queried key value
-     * @return target string ("" if not exist)
+     * @param value set to the found value, may be "~DELETED~"
+     * @param cache block cache to consult first, nullptr to read the file directly
+     *              (unused when the table is mapped and uncompressed, the page cache serves instead)
+     * @return OK if key exists in this table, CORRUPTION if the data that may hold it can't be read
      */
-    std::string get(uint64_t key);
+    Status get(uint64_t key, PinnedValue &value, BlockCache *cache = nullptr);
 
     /**
      * Delete file linked with current SSTable.
      */
     void delete_file();
 
+    /**
+     * Delete linked file on destruction, called when the table is
+     * compacted away. Readers still holding the table can use it till then.
+     * @param newer if set, kept alive till this table's file is deleted and its
+     *        directory synced: merged inputs found at restart must not lack a newer one,
+     *        an older input would shadow the merged table (or bring back keys whose
+     *        "~DELETED~" flags were dropped)
+     */
+    void mark_obsolete(const std::shared_ptr<SSTable> &newer = nullptr);
+
     std::string get_table_path();
+
+    /**
+     * @return true if the file is complete, synced and under its name (with its
+     *         directory entry synced), false if writing it failed and the table can't be used
+     */
+    bool is_durable() const;
 };
@@ -1,45 +1,150 @@
 /**
  * @brief Data Structure to implement DRAM storage part of LSM Tree
- *        Implemented by SkipList<K, V>
+ *        Implemented by lock-free SkipList<K, V>
  *        typeof K = unit64_t; typeof V = std::string
+ *        Writers insert concurrently by CAS, readers never lock or retry.
+ *        Nodes and values live in an Arena, released all at once.
  *        Uncommon SkipList: has size limit
  * @author JolyneFr 519021910390
  */
 
 #pragma once
 
-#include "global.h"
+#include <atomic>
+#include "Arena.h"
+#include "Iterator.h"
 
 class SkipList {
 
 private:
-    
-    uint64_t data_count = 0;  // number of datas in memTable
-    uint64_t data_total_length = 0; // total length of all strings
 
-    ListNode *head;
+    static const int MAX_HEIGHT = 12;
 
-    ListNode *lowest_head;
+    /**
+     * Value of a key, its bytes follow in the same allocation.
+     * An overwritten value stays in the Arena, readers may still be copying it.
+     */
+    struct Value {
+        const uint64_t size;
+        explicit Value(uint64_t s): size(s) {}
+        const char *data() const { return reinterpret_cast<const char*>(this + 1); }
+    };
+
+    /**
+     * Tower of a key in a single allocation: next holds one link per level,
+     * node height is only known to its allocator.
+     */
+    struct Node {
+        const uint64_t key;
+        std::atomic<const Value*> value;
+        std::atomic<Node*> next[1];
+        Node(uint64_t k, const Value *v): key(k), value(v), next{{nullptr}} {}
+    };
+
+    Arena arena;
+
+    Node *head;
+
+    std::atomic<int> max_height;  // height of the tallest tower
+
+    std::atomic<uint64_t> data_count;  // number of datas in memTable
+
+    std::atomic<uint64_t> byte_size;  // size of the SSTable generated from memTable
+
+    Node *new_node(uint64_t key, const Value *value, int height);
+
+    const Value *new_value(const std::string &value);
+
+    static int random_height();
+
+    /**
+     * Add delta to byte_size.
+     * @return false (nothing changed) if byte_size would exceed MAX_BYTE_SIZE
+     */
+    bool reserve(int64_t delta);
+
+    /**
+     * Fill prev / next of levels below height with nodes around key.
+     */
+    void find_splice(uint64_t key, Node **prev, Node **next, int height) const;
+
+    /**
+     * Link node between prev[level] and next[level], searching again if
+     * another writer got there first.
+     * @return false if a node with the same key was linked instead
+     */
+    static bool link(Node *node, int level, Node **prev, Node **next);
+
+    /**
+     * Replace value of an existing node.
+     */
+    bool update(Node *node, const std::string &value);
+
+    Node *find_greater_or_equal(uint64_t key) const;
+
+    /**
+     * @return last node with key < given key, head if none
+     */
+    Node *find_less_than(uint64_t key) const;
+
+    /**
+     * @return last node, head if list is empty
+     */
+    Node *find_last() const;
 
-    ListNode *find(uint64_t key);
+    void init();
 
 public:
+
+    /**
+     * Iterator over key-value pairs in key order.
+     * Safe to use while other threads put, prev() costs a search.
+     */
+    class Iterator : public ::Iterator {
+    private:
+        const SkipList *list;
+        const Node *node;
+    public:
+        /**
+         * Position at the smallest key of list.
+         */
+        explicit Iterator(const SkipList &list);
+        bool valid() const override;
+        void seek_to_first() override;
+        void seek_to_last() override;
+        void seek(uint64_t key) override;
+        void seek_for_prev(uint64_t key) override;
+        void next() override;
+        void prev() override;
+        uint64_t key() const override;
+        /**
+         * @return current value, valid as long as the SkipList exists
+         */
+        Slice value() override;
+    };
+
     /**
-     * default constructor & destructor for MemTable
+     * default constructor for MemTable, all memory is freed with its Arena
      */
     SkipList();
-    ~SkipList();
 
     /**
      * Try to read value marked by key
      * @param key target key number
-     * @return target value if key exists 
+     * @return target value if key exists
      *         (An empty string indicates not found.)
      */
-    std::string get(uint64_t key);
+    std::string get(uint64_t key) const;
 
     /**
-     * Put key-value pair into memTable.
+     * Read value marked by key without copying it.
+     * @param value set to the stored value, valid as long as the SkipList exists
+     * @return true if key exists
+     */
+    bool get(uint64_t key, Slice &value) const;
+
+    /**
+     * Put key-value pair into memTable, safe to call from several threads.
      * If the data size would exceed the MemTable limit after the operation,
      * then do not execute put operation.
      * @param key key to be insert
@@ -48,24 +153,11 @@ public:
      */
     bool put(uint64_t key, const std::string& value);
 
-    /**
-     * Remove key-value pair with certain key
-     * @param key target key for remove
-     * @return if the key exists
-     */
-    bool remove(uint64_t key);
-
     /**
      * get data in SkipList in the order of key value undecreased.
      * @return std vector that store all data.
      */
-    std::vector<value_type> *exported_data();
-
-    /**
-     * get the lowest head node
-     * @return the head node at the bottom
-     */
-    ListNode *get_bottom_head();
+    std::vector<value_type> *exported_data() const;
 
     /**
      * Memory size after this MemTable being generated to .sst file
@@ -80,8 +172,14 @@ public:
     uint64_t get_kv_count() const;
 
     /**
-     * Clear all data in this memTable
+     * @return bytes of memory held by the Arena
+     */
+    size_t get_memory_usage() const;
+
+    /**
+     * Clear all data in this memTable.
+     * No other thread may use the SkipList meanwhile.
      */
     void clear();
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,29 @@
+/**
+ * @brief Per-store state of reading SSTables: cached open files, the read mode,
+ *        and the cache of index partitions & filters of partitioned tables.
+ *        Owned by a DiskRepo and shared by all of its tables, so stores of one
+ *        process never see each other's settings.
+ */
+
+#pragma once
+
+#include <memory>
+#include "FileCache.h"
+#include "BlockCache.h"
+#include "Options.h"
+
+struct TableCache {
+    // open files for point reads, options.max_open_files at most
+    FileCache files;
+    // read values through a mapping of each file instead of pread
+    const bool mmap_reads;
+    // index partitions & bloom filters of tables with a partitioned index
+    BlockCache metadata;
+
+    explicit TableCache(const Options &options = Options());
+
+    /**
+     * @return cache of tables opened outside any store (default options)
+     */
+    static std::shared_ptr<TableCache> standalone();
+};
@@ -0,0 +1,104 @@
+/**
+ * @brief Immutable snapshots of the level structure on disk.
+ *        Readers take the current Version and search it without locks;
+ *        flushes and compactions build a new Version and install it.
+ *        SSTables dropped by a newer Version stay readable, and their
+ *        files are deleted when the last Version holding them is released.
+ *
+ *        Data of a key is newer the higher its level, so a get stops at the first hit:
+ *        - flushes only add tables to level-0, with a time stamp above all others;
+ *        - level-0 tables may overlap, a newer time stamp holds newer data;
+ *        - levels below level-0 hold tables with disjoint key ranges, so a key lives in
+ *          at most one table per level (leveled compaction), or sorted runs whose tables
+ *          share a time stamp, a newer one holding newer data (universal compaction);
+ *        - a compaction replaces its inputs from level i & i+1 with merged tables in
+ *          level i+1 in a single install, moving a key down only together with every
+ *          older version of it in level i+1; universal compaction merges level-0 into a new
+ *          run of level-1, or the newest runs of level-1 into one.
+ */
+
+#pragma once
+
+#include "Level.h"
+
+class Version {
+
+private:
+
+    std::vector<Level> levels;
+
+public:
+
+    /**
+     * Construct a Version without any level.
+     */
+    Version() = default;
+
+    /**
+     * @return number of levels
+     */
+    size_t level_count() const;
+
+    /**
+     * @return level with given level-number, must be below level_count()
+     */
+    const Level &get_level(size_t index) const;
+
+    /**
+     * Modifiable level, only used on a Version not yet installed.
+     */
+    Level &edit_level(size_t index);
+
+    /**
+     * Append a level below the existing ones.
+     */
+    void add_level(const Level &new_level);
+
+    /**
+     * Search levels from level-0 down, stopping at the first one holding key.
+     * @param value set to the found value, may be "~DELETED~"
+     * @param cache block cache for value reads, may be nullptr
+     * @param probes increased by the number of tables searched
+     * @return OK if found, CORRUPTION if a table that may hold key can't be read:
+     *         older data of key must not be served in its place
+     */
+    Status get(uint64_t key, PinnedValue &value, BlockCache *cache, size_t &probes) const;
+
+    /**
+     * Append iterators over all levels to iters, upper levels first.
+     * They keep their SSTables alive after this Version is released.
+     * Tables that surely hold no key of [start, end] are left out.
+     */
+    void add_iterators(std::vector<std::unique_ptr<Iterator>> &iters,
+                       uint64_t start = 0, uint64_t end = UINT64_MAX) const;
+
+    bool check_overlap() const;
+};
+
+typedef std::shared_ptr<const Version> version_ptr;
+
+class VersionSet {
+
+private:
+
+    // read & written through std::atomic_load / std::atomic_store only
+    version_ptr current_version;
+
+public:
+
+    /**
+     * Construct a VersionSet whose current Version has no level.
+     */
+    VersionSet();
+
+    /**
+     * @return the latest installed Version, valid as long as it is held
+     */
+    version_ptr current() const;
+
+    /**
+     * Replace the current Version, old one is released by its last reader.
+     * Installs must be serialized by the caller.
+     */
+    void install(const version_ptr &new_version);
+};
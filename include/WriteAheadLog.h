@@ -0,0 +1,110 @@
+/**
+ * @brief Append-only redo log of the MemTable.
+ *        Every put / del is appended here before the call returns,
+ *        so data that has not reached an SSTable survives a crash.
+ *        Log files live in the root directory as <number>.log.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "global.h"
+#include "Options.h"
+
+class WriteAheadLog {
+
+public:
+
+    /* ----- key & value of a record to append, value not copied ----- */
+    typedef std::pair<uint64_t, const std::string*> record_ref;
+
+private:
+
+    const std::string dir;
+    const SyncMode sync_mode;
+    const uint64_t sync_interval_ms;
+
+    uint64_t log_number;  // number of the log file being appended
+    int log_fd;
+
+    std::mutex log_mutex;
+    std::condition_variable sync_cv;
+    bool sync_active = false;   // log_fd is being synced outside log_mutex (periodic mode)
+    bool dirty = false;       // unsynced bytes exist (periodic mode)
+    bool stopping = false;
+    std::thread sync_thread;
+
+    std::string log_path(uint64_t number) const;
+
+    std::vector<uint64_t> list_logs() const;
+
+    /**
+     * Make log file of number the current one, with its directory entry synced,
+     * aborting the process if it can't be opened or synced.
+     */
+    void open_log(uint64_t number);
+
+    /**
+     * Write buf to the current log file, aborting the process if it fails:
+     * the records in it must not be acknowledged.
+     */
+    void write_all(const std::string &buf);
+
+    /**
+     * Sync log file fd to stable storage, aborting the process if it fails.
+     */
+    void sync_log(int fd);
+
+    void sync_loop();
+
+public:
+    /**
+     * Open a new log file after all existing ones in dir.
+     * Existing logs are kept untouched until replayed and removed.
+     */
+    WriteAheadLog(const std::string &dir, SyncMode mode, uint64_t interval_ms);
+
+    /**
+     * Sync and close the current log file (no file deleted).
+     */
+    ~WriteAheadLog();
+
+    /**
+     * Feed every intact record of older log files to apply, in write order.
+     * A torn or corrupted tail ends the replay of that file.
+     */
+    void replay(const std::function<void(uint64_t, const std::string&)> &apply);
+
+    /**
+     * Append a key-value pair, returns after it is durable under sync_mode.
+     * A failed write or sync aborts the process instead of returning.
+     */
+    void append(uint64_t key, const std::string &value);
+
+    /**
+     * Append several key-value pairs at once, in order,
+     * returns after all of them are durable under sync_mode.
+     * Called by one thread at a time: KVStore's writer queue hands it the
+     * puts / dels of concurrent writers as one batch, synced together in group commit.
+     */
+    void append(const std::vector<record_ref> &records);
+
+    /**
+     * Switch appending to a fresh log file.
+     * @return number of the new log, older logs become removable
+     */
+    uint64_t rotate();
+
+    /**
+     * Delete all log files whose number is smaller than the given one.
+     */
+    void remove_logs_before(uint64_t number);
+
+    /**
+     * Delete all log files and restart with an empty one.
+     */
+    void clear();
+};
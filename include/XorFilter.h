@@ -0,0 +1,32 @@
+/**
+ * @brief Static xor filter over uint64 keys (8-bit fingerprints), stored as raw bytes.
+ *        Each key maps to one slot in each of three segments, and the fingerprints in
+ *        these slots xor to the fingerprint of the key. About 9.8 bits per key for
+ *        0.4% false positives: next to the default 10 bits per key bloom filter
+ *        (about 1%) that is the same memory for fewer false positives, a bloom
+ *        filter needs about 14 bits per key to reach 0.4%.
+ *        All keys must be known up front: the filter is built once, then only read.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace xor_filter {
+
+    /**
+     * Build the filter of keys into filter.
+     * @param keys distinct keys
+     * @return false if no filter could be built, filter is then cleared
+     */
+    bool build(const std::vector<uint64_t> &keys, std::string &filter);
+
+    /**
+     * @return false if key was surely not added, always true for an empty filter
+     */
+    bool may_contain(const char *filter, size_t size, uint64_t key);
+
+}
@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <cstring>
 
 /* ----- Global constant value for SSTable ----- */
 const uint64_t MAX_BYTE_SIZE = 1 << 21;
@@ -20,6 +21,27 @@ typedef std::pair<uint64_t, uint64_t> scope_type;
 /* ----- <time_stamp, min_key>, easier way to store a level ----- */
 typedef std::pair<uint64_t, uint64_t> key_type;
 
+/* ----- Outcome of reading data from disk ----- */
+enum class Status {
+    OK,
+    NOT_FOUND,
+    CORRUPTION,  // a file can't be read, or its checksum or compression is broken
+    IO_ERROR     // a file can't be written or synced
+};
+
+/* ----- Bytes of a value, kept alive by their owner ----- */
+struct Slice {
+    const char *data;
+    size_t size;
+    Slice(): data(""), size(0) {}
+    Slice(const char *d, size_t s): data(d), size(s) {}
+    explicit Slice(const std::string &str): data(str.data()), size(str.size()) {}
+    std::string to_string() const { return std::string(data, size); }
+    bool operator==(const std::string &str) const {
+        return size == str.size() && !memcmp(data, str.data(), size);
+    }
+};
+
 /* ----- Calculate file size after written to SSTable ----- */
 uint64_t cal_size(uint64_t count, uint64_t length);
 
@@ -31,37 +53,5 @@ bool in_scope(std::pair<uint64_t, uint64_t> scope, uint64_t key);
 
 /* ----- Check if a file name ends with .sst ----- */
 bool sst_suffix(const char* filePath);
-
-
-/**
- * Node struct of SkipList & MergeBuffer.
- * put it in global.h to implement a faster constructor of SSTable.
- */
-struct ListNode {
-    uint64_t key = 0;
-    std::string value;
-    ListNode *prev, *next, *below;
-
-    ListNode(): prev(nullptr), next(nullptr), below(nullptr) {}
-    ListNode(const uint64_t &k, std::string v):
-        key(k), value(std::move(v)), prev(nullptr), next(nullptr), below(nullptr) {}
-    ~ListNode() = default;
-    void insertAfterAbove(ListNode *p, ListNode *b);
-};
-
-/**
- * Store min_key & time_stamp, rewrite operator< to implement a heap.
- * Only used in function merge_table.
- */
-struct MergeInfo {
-    uint64_t min_key;
-    uint64_t time_stamp;
-    uint64_t index = 0;
-    uint64_t table_index;
-    std::ifstream *file_stream;
-
-    MergeInfo(uint64_t mk, uint64_t ts, uint64_t i, uint64_t ti, std::ifstream *fs):
-        min_key(mk), time_stamp(ts), index(i), table_index(ti), file_stream(fs) {}
-
-    friend bool operator<(MergeInfo a, MergeInfo b);
-};
+/* ----- CRC-32 (IEEE) checksum of a byte sequence ----- */
+uint32_t crc32(const char *data, size_t n);
@@ -3,12 +3,101 @@
 #include "kvstore_api.h"
 #include "SkipList.h"
 #include "DiskRepo.h"
+#include "WriteAheadLog.h"
+#include "KVIterator.h"
+#include <deque>
+#include <memory>
 
 class KVStore : public KVStoreAPI {
 	// You can add your implementation here
 private:
-    SkipList memTable;
+    /**
+     * A full memTable waiting for the flush thread.
+     * log_number: logs before it are removable once the table is on disk
+     * (0 if the table was rebuilt by replay and no log may be removed).
+     */
+    struct ImmutableTable {
+        std::shared_ptr<SkipList> table;
+        uint64_t log_number;
+    };
+
+    /**
+     * A put / del waiting in the writer queue, or a reset if value is nullptr.
+     * Owned by the calling thread, done is set by the leader that applied it.
+     */
+    struct Writer {
+        uint64_t key;
+        const std::string *value;
+        bool done = false;
+        std::condition_variable cv;
+        Writer(uint64_t k, const std::string *v): key(k), value(v) {}
+    };
+
+    /* ----- memTables seen by a reader: the active one, then the immutable ones newest first ----- */
+    typedef std::vector<std::shared_ptr<SkipList>> MemTables;
+
+    // the one being written, swapped by the leader (or replay) only
+    std::shared_ptr<SkipList> memTable;
+    std::deque<ImmutableTable> immTables;  // oldest first
+    // published copy of memTable & immTables for readers, never changed once published:
+    // read & swapped through std::atomic_load / std::atomic_store only
+    std::shared_ptr<const MemTables> mem_tables;
     DiskRepo diskStore;
+    WriteAheadLog wal;
+
+    const size_t max_immutable;
+    const size_t max_batch;
+    std::mutex writer_mutex;             // guards writers
+    std::deque<Writer*> writers;         // the front one leads, applying a batch
+    std::mutex state_mutex;              // guards memTable swap, immTables & publishing them
+    std::condition_variable flush_cv;    // flush thread waits for work
+    std::condition_variable room_cv;     // writers wait for a free slot
+    bool stopping = false;
+    // set once a table was dropped without reaching disk, its logs must then stay
+    bool keep_logs = false;
+    std::thread flush_thread;
+
+    /**
+     * Queue a writer and wait until some leader has applied it.
+     * The writer at the front becomes leader and applies itself together
+     * with the puts / dels queued behind it.
+     */
+    void write(Writer &w);
+
+    /**
+     * Log a batch of puts / dels, then apply them to memTable in one pass, handing
+     * it to the flush thread first when they may not fit. Called by the leader only.
+     */
+    void apply_batch(const std::vector<Writer*> &batch);
+
+    /**
+     * Remove all data in memory and on disk. Called by the leader only.
+     */
+    void clear_all();
+
+    /**
+     * Swap memTable into the immutable queue, blocking while the queue is full.
+     * Caller must hold state_mutex.
+     * @param log_number logs before it hold only data of memTable and older tables
+     */
+    void seal_memtable(std::unique_lock<std::mutex> &lock, uint64_t log_number);
+
+    /**
+     * Publish memTable & immTables to readers as a new mem_tables.
+     * Caller must hold state_mutex.
+     */
+    void publish_memtables();
+
+    /**
+     * Body of flush_thread: write immutable memTables to disk, oldest first.
+     */
+    void flush_loop();
+
+    /**
+     * Create an iterator only meant for keys in [start, end]:
+     * SSTables that surely hold none of them (by scope & range filter) are left out.
+     */
+    std::unique_ptr<KVIterator> range_iterator(uint64_t start, uint64_t end);
 
 public:
     /**
@@ -18,29 +107,78 @@ public:
      */
 	explicit KVStore(const std::string &dir);
 
+    /**
+     * Construct a KVStore under "dir" with given options.
+     * Writes logged but not yet saved in SSTables are replayed into memTable.
+     */
+	KVStore(const std::string &dir, const Options &options);
+
 	/**
-	 * Destruct KVStore after writing data in memTable to disk.
+	 * Destruct KVStore after writing data in memTable and
+	 * all pending immutable memTables to disk.
 	 */
 	~KVStore();
 
 	/**
 	 * Insert/Update the key-value pair.
      * No return values for simplicity.
+     * Returns once logged: synced unless options.sync_mode is PERIODIC,
+     * where the last sync_interval_ms of writes may be lost in a crash.
 	 */
 	void put(uint64_t key, const std::string &s) override;
 
     /**
     * Returns the (string) value of the given key.
     * An empty string indicates not found.
+    * Safe to call from many threads, in parallel with writes.
     */
 	std::string get(uint64_t key) override;
 
+    /**
+     * Find the value of the given key without copying it when possible:
+     * value points into a memTable, a cached block or a mapped file and
+     * pins it, only values spanning blocks or read from file are copied (once).
+     * Returns false iff the key is not found, value is then reset.
+     * A key whose table can't be read is not found either, see get_read_errors().
+     */
+    bool get(uint64_t key, PinnedValue &value);
+
     /**
      * Delete the given key-value pair if it exists.
      * Returns false iff the key is not found.
      */
 	bool del(uint64_t key) override;
 
+    /**
+     * @return block cache serving gets (hit / miss counters), nullptr if disabled
+     */
+    const BlockCache *get_block_cache() const;
+
+    /**
+     * @return number of SSTables searched by gets so far
+     */
+    uint64_t get_table_probes() const;
+
+    /**
+     * @return number of gets failed by a corrupted table (reported on stderr),
+     *         instead of answering with older data of the key
+     */
+    uint64_t get_read_errors() const;
+
+    /**
+     * Create an iterator over all key-value pairs, unpositioned.
+     * Writes made while iterating may or may not be seen.
+     */
+    std::unique_ptr<KVIterator> new_iterator();
+
+    /**
+     * Visit key-value pairs with start <= key <= end in key order.
+     * @return CORRUPTION if a table could not be read: the scan stopped there,
+     *         pairs visited so far are right but the rest of the range is missing
+     */
+    Status scan(uint64_t start, uint64_t end,
+              const std::function<void(uint64_t, const std::string&)> &visit);
+
     /**
      * This resets the kvstore. All key-value pairs should be removed,
      * including memtable and all sstables files.
@@ -5,6 +5,7 @@
 #include <vector>
 #include <sys/types.h>
 #include <string.h>
+#include <fcntl.h>
 
 #ifdef _WIN32
 #include <direct.h>
@@ -15,6 +16,7 @@
 #if defined(__linux__) || defined(__MINGW32__) || defined(__APPLE__)
 #include <dirent.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #endif
 
 namespace utils{
@@ -137,6 +139,88 @@ namespace utils{
             return ::unlink(path);
         #endif
     }
+    /**
+     * Flush written data of an open file to stable storage
+     * @param fd file descriptor of the file.
+     * @return 0 if synced successfully, -1 otherwise.
+     */
+    static inline int syncFile(int fd){
+        #ifdef _WIN32
+            return ::_commit(fd);
+        #elif defined(__APPLE__)
+            return ::fsync(fd);
+        #else
+            return ::fdatasync(fd);
+        #endif
+    }
+
+    /**
+     * Flush a closed file, or the entries of a directory, to stable storage.
+     * Directories can't be synced on Windows, they are skipped there.
+     * @param path file or directory to be synced.
+     * @return 0 if synced successfully, -1 otherwise.
+     */
+    static inline int syncPath(const char *path, bool is_dir){
+        #ifdef _WIN32
+            if (is_dir) return 0;
+            int fd = ::_open(path, _O_RDWR | _O_BINARY);
+            if (fd < 0) return -1;
+            int ret = ::_commit(fd);
+            ::_close(fd);
+        #else
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0) return -1;
+            // entries of a directory are metadata, left to a full fsync
+            int ret = is_dir ? ::fsync(fd) : syncFile(fd);
+            ::close(fd);
+        #endif
+        return ret;
+    }
+
+    /**
+     * Read n bytes at offset of an opened file, without moving a shared file position
+     * (except on Windows).
+     * @return bytes read, -1 on error
+     */
+    static inline long long readFileAt(int fd, char *buf, size_t n, uint64_t offset){
+        #ifdef _WIN32
+            if (::_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+            return ::_read(fd, buf, (unsigned)n);
+        #else
+            return ::pread(fd, buf, n, offset);
+        #endif
+    }
+
+    /**
+     * Map the first size bytes of an open file read-only.
+     * The mapping outlives fd, release it by unmapFile.
+     * @return start of mapping, nullptr if failed or not supported
+     */
+    static inline const char *mapFile(int fd, size_t size){
+        #ifdef _WIN32
+            return nullptr;
+        #else
+            if (size == 0) return nullptr;
+            void *addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            return addr == MAP_FAILED ? nullptr : (const char*)addr;
+        #endif
+    }
+
+    static inline void unmapFile(const char *addr, size_t size){
+        #ifndef _WIN32
+            ::munmap((void*)addr, size);
+        #endif
+    }
+
+    /**
+     * Tell the kernel how a mapping is about to be read.
+     * @param sequential true for front-to-back scans, false for random point reads
+     */
+    static inline void adviseFile(const char *addr, size_t size, bool sequential){
+        #ifndef _WIN32
+            ::madvise((void*)addr, size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        #endif
+    }
 
 
     
@@ -0,0 +1,45 @@
+#include <new>
+#include "Arena.h"
+
+Arena::Arena(): memory_usage(0) {
+    current = new_block(BLOCK_SIZE);
+}
+
+Arena::Block *Arena::new_block(size_t bytes) {
+    size_t total = sizeof(Block) + bytes;
+    blocks.emplace_back(new char[total]);
+    memory_usage += total;
+    char *mem = blocks.back().get();
+    return new (mem) Block(mem + sizeof(Block), bytes);
+}
+
+char *Arena::allocate(size_t bytes) {
+    bytes = (bytes + 7) & ~(size_t)7;
+    if (bytes > BLOCK_SIZE / 4) {
+        // large request gets its own block, the current one keeps its free space
+        std::lock_guard<std::mutex> lock(block_mutex);
+        return new_block(bytes)->data;
+    }
+    while (true) {
+        Block *block = current.load(std::memory_order_acquire);
+        size_t offset = block->used.fetch_add(bytes, std::memory_order_relaxed);
+        if (offset + bytes <= block->size) {
+            return block->data + offset;
+        }
+        // block is full, the first thread here replaces it
+        std::lock_guard<std::mutex> lock(block_mutex);
+        if (current.load(std::memory_order_relaxed) == block) {
+            current.store(new_block(BLOCK_SIZE), std::memory_order_release);
+        }
+    }
+}
+
+void Arena::clear() {
+    blocks.clear();
+    memory_usage = 0;
+    current = new_block(BLOCK_SIZE);
+}
+
+size_t Arena::get_memory_usage() const {
+    return memory_usage;
+}
@@ -0,0 +1,58 @@
+#include "BlockCache.h"
+
+BlockCache::BlockCache(size_t capacity):
+    shard_capacity((capacity + SHARD_COUNT - 1) / SHARD_COUNT), hits(0), misses(0) {}
+
+void BlockCache::evict(Shard &shard) {
+    while (shard.usage > shard_capacity && shard.lru.size() > 1) {
+        auto &victim = shard.lru.back();
+        shard.usage -= victim.second->size();
+        shard.blocks.erase(victim.first);
+        shard.lru.pop_back();
+    }
+}
+
+BlockCache::Shard &BlockCache::shard_of(const BlockKey &key) {
+    return shards[BlockKeyHash()(key) % SHARD_COUNT];
+}
+
+BlockCache::block_ptr BlockCache::lookup(uint64_t table, uint64_t block) {
+    BlockKey key{table, block};
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.shard_mutex);
+    auto found = shard.blocks.find(key);
+    if (found == shard.blocks.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    // move to front as most recently used
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    return found->second->second;
+}
+
+BlockCache::block_ptr BlockCache::insert(uint64_t table, uint64_t block, std::string data) {
+    BlockKey key{table, block};
+    auto cached = std::make_shared<const std::string>(std::move(data));
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.shard_mutex);
+    auto found = shard.blocks.find(key);
+    if (found != shard.blocks.end()) {
+        // another reader cached it first
+        shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+        return found->second->second;
+    }
+    shard.lru.emplace_front(key, cached);
+    shard.blocks[key] = shard.lru.begin();
+    shard.usage += cached->size();
+    evict(shard);
+    return cached;
+}
+
+uint64_t BlockCache::get_hits() const {
+    return hits;
+}
+
+uint64_t BlockCache::get_misses() const {
+    return misses;
+}
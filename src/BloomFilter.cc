@@ -0,0 +1,66 @@
+#include <cstring>
+#include "BloomFilter.h"
+
+namespace {
+    const size_t WORDS = 8;
+
+    // odd multipliers spreading a 32-bit hash over the bit of each word
+    const uint32_t SALT[WORDS] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+    };
+
+    uint64_t hash_key(uint64_t key) {
+        // MurmurHash3 finalizer, keys are often sequential
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    /**
+     * @return offset of the block of hash in a filter of size bytes
+     */
+    size_t block_offset(uint64_t hash, size_t size) {
+        uint64_t block_count = size / bloom::BLOCK_BYTES;
+        return (size_t)(((hash >> 32) * block_count) >> 32) * bloom::BLOCK_BYTES;
+    }
+
+    void make_mask(uint32_t hash, uint32_t mask[WORDS]) {
+        for (size_t i = 0; i < WORDS; ++i) {
+            mask[i] = 1u << ((hash * SALT[i]) >> 27);
+        }
+    }
+}
+
+size_t bloom::filter_size(uint64_t key_count, size_t bits_per_key) {
+    if (bits_per_key == 0) return 0;
+    size_t block_bits = BLOCK_BYTES * 8;
+    uint64_t blocks = (key_count * bits_per_key + block_bits - 1) / block_bits;
+    return (size_t)(blocks ? blocks : 1) * BLOCK_BYTES;
+}
+
+void bloom::add(char *filter, size_t size, uint64_t key) {
+    if (size < BLOCK_BYTES) return;
+    uint64_t hash = hash_key(key);
+    char *block = filter + block_offset(hash, size);
+    uint32_t mask[WORDS], words[WORDS];
+    make_mask((uint32_t)hash, mask);
+    memcpy(words, block, BLOCK_BYTES);
+    for (size_t i = 0; i < WORDS; ++i) words[i] |= mask[i];
+    memcpy(block, words, BLOCK_BYTES);
+}
+
+bool bloom::may_contain(const char *filter, size_t size, uint64_t key) {
+    if (size < BLOCK_BYTES) return true;
+    uint64_t hash = hash_key(key);
+    uint32_t mask[WORDS], words[WORDS];
+    make_mask((uint32_t)hash, mask);
+    memcpy(words, filter + block_offset(hash, size), BLOCK_BYTES);
+    // no early exit, so the eight tests are vectorized
+    uint32_t missing = 0;
+    for (size_t i = 0; i < WORDS; ++i) missing |= mask[i] & ~words[i];
+    return missing == 0;
+}
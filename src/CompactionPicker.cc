@@ -0,0 +1,190 @@
+#include "CompactionPicker.h"
+#include <algorithm>
+
+std::unique_ptr<CompactionPicker> CompactionPicker::create(const Options &options) {
+    if (options.compaction_style == CompactionStyle::UNIVERSAL) {
+        return std::unique_ptr<CompactionPicker>(new UniversalPicker(options));
+    }
+    return std::unique_ptr<CompactionPicker>(new LeveledPicker(options));
+}
+
+bool CompactionPicker::pick_level0(const Version &version, Compaction &compaction) {
+    if (!version.level_count()) return false;
+    const Level &level0 = version.get_level(0);
+    if (level0.get_size() <= 2) return false;
+    compaction.input_level = 0;
+    compaction.inputs = level0.first_k(level0.get_size());
+    std::reverse(compaction.inputs.begin(), compaction.inputs.end());
+    return true;
+}
+
+/* ----- Leveled ----- */
+
+LeveledPicker::LeveledPicker(const Options &options):
+    compaction_candidates(std::max(options.compaction_candidates, (size_t)1)),
+    level1_target_bytes(std::max(options.level1_target_bytes, (uint64_t)1)),
+    level_size_multiplier(std::max(options.level_size_multiplier, (uint64_t)2)),
+    dynamic_level_bytes(options.dynamic_level_bytes) {}
+
+uint64_t LeveledPicker::target_bytes(const Version &version, size_t index) const {
+    uint64_t target = level1_target_bytes;
+    for (size_t i = 1; i < index; ++i) target *= level_size_multiplier;
+    size_t bottom = version.level_count() - 1;
+    if (!dynamic_level_bytes || index >= bottom) return target;
+
+    // upper levels take 1 / multiplier of the level below, starting from what the bottom holds
+    uint64_t dynamic = version.get_level(bottom).get_bytes();
+    for (size_t i = index; i < bottom; ++i) dynamic /= level_size_multiplier;
+    return std::max(dynamic, level1_target_bytes);
+}
+
+double LeveledPicker::level_score(const Version &version, size_t index) const {
+    const Level &level = version.get_level(index);
+    if (index == 0) {
+        // level-0 tables are all searched by a get, count them instead
+        return (double)level.get_size() / 2.0;
+    }
+    return (double)level.get_bytes() / (double)target_bytes(version, index);
+}
+
+table_ptr LeveledPicker::pick_table(const Version &version, size_t index) {
+    const Level &upper_level = version.get_level(index);
+    if (!upper_level.is_disjoint()) {
+        // overlapping tables leave the level oldest first, newer data stays above
+        return upper_level.first_k(1).front();
+    }
+    if (compact_cursors.size() <= index) compact_cursors.resize(index + 1, 0);
+    uint64_t &cursor = compact_cursors[index];
+
+    const std::vector<table_ptr> &tables = upper_level.sorted_tables();
+    size_t first = 0;
+    while (first < tables.size() && tables[first]->get_scope().first < cursor) ++first;
+    if (first == tables.size()) first = 0;  // wrap around to the smallest key
+
+    bool has_next = index + 1 < version.level_count();
+    table_ptr picked;
+    uint64_t min_overlap = UINT64_MAX;
+    for (size_t n = 0; n < std::min(compaction_candidates, tables.size()); ++n) {
+        const table_ptr &candidate = tables[(first + n) % tables.size()];
+        uint64_t overlap = 0;
+        if (has_next) {
+            for (auto &next_table : version.get_level(index + 1).overlapping(candidate->get_scope())) {
+                overlap += next_table->get_raw_size();
+            }
+        }
+        if (overlap < min_overlap) {
+            min_overlap = overlap;
+            picked = candidate;
+        }
+    }
+
+    uint64_t max_key = picked->get_scope().second;
+    cursor = max_key == UINT64_MAX ? 0 : max_key + 1;
+    return picked;
+}
+
+bool LeveledPicker::pick(const Version &version, Compaction &compaction) {
+    // the level most in need of compaction
+    size_t index = 0;
+    double max_score = 1.0;
+    bool found = false;
+    for (size_t i = 0; i < version.level_count(); ++i) {
+        double score = level_score(version, i);
+        if (score > max_score) {
+            max_score = score;
+            index = i;
+            found = true;
+        }
+    }
+    if (!found) return false;
+
+    if (index == 0) {
+        // level-0: compact all, newest first
+        pick_level0(version, compaction);
+    } else {
+        // not level-0: one table a time, till the level fits again
+        compaction.input_level = index;
+        compaction.inputs.assign(1, pick_table(version, index));
+    }
+
+    scope_type overflow_scope = std::make_pair(UINT64_MAX, 0);
+    for (auto &cur_table : compaction.inputs) {
+        auto cur_scope = cur_table->get_scope();
+        if (cur_scope.first < overflow_scope.first)
+            overflow_scope.first = cur_scope.first;
+        if (cur_scope.second > overflow_scope.second)
+            overflow_scope.second = cur_scope.second;
+    }
+
+    compaction.output_level = index + 1;
+    compaction.overlapped.clear();
+    if (index + 1 < version.level_count()) {
+        compaction.overlapped = version.get_level(index + 1).overlapping(overflow_scope);
+    }
+    // if next level is the bottom, delete all "~DELETED~" flags
+    compaction.is_delete = index + 2 >= version.level_count();
+    return true;
+}
+
+/* ----- Universal ----- */
+
+UniversalPicker::UniversalPicker(const Options &options):
+    max_runs(std::max(options.universal_max_runs, (size_t)1)),
+    size_ratio(options.universal_size_ratio),
+    max_size_amplification(options.universal_max_size_amplification) {}
+
+bool UniversalPicker::pick(const Version &version, Compaction &compaction) {
+    size_t level_count = version.level_count();
+    if (pick_level0(version, compaction)) {
+        // flushed tables become one new run, older runs untouched
+        compaction.output_level = 1;
+        compaction.overlapped.clear();
+        compaction.is_delete = level_count < 2 || (level_count == 2 && !version.get_level(1).get_size());
+        return true;
+    }
+    if (level_count < 2) return false;
+
+    // sorted runs of level-1, newest first: tables of one run share a time stamp
+    struct Run {
+        uint64_t bytes;
+        std::vector<table_ptr> tables;
+    };
+    std::vector<Run> runs;
+    const auto *tables = version.get_level(1).get_level();
+    for (auto table = tables->rbegin(); table != tables->rend(); ++table) {
+        if (runs.empty() || table->first.first != runs.back().tables.front()->get_time_stamp()) {
+            runs.push_back(Run{0, {}});
+        }
+        runs.back().bytes += table->second->get_raw_size();
+        runs.back().tables.push_back(table->second);
+    }
+    if (runs.size() <= max_runs) return false;
+
+    // merged runs always start from the newest one, so the merged run
+    // (with a new time stamp) is still newer than all runs left
+    size_t width = runs.size();
+    uint64_t newer_bytes = 0;
+    for (size_t i = 0; i + 1 < runs.size(); ++i) newer_bytes += runs[i].bytes;
+    if (newer_bytes * 100 < max_size_amplification * runs.back().bytes) {
+        // newer runs are still small next to the oldest: merge those of similar size only
+        uint64_t merged_bytes = runs[0].bytes;
+        width = 1;
+        while (width < runs.size() && runs[width].bytes * 100 <= merged_bytes * (100 + size_ratio)) {
+            merged_bytes += runs[width++].bytes;
+        }
+        if (width < 2) {
+            // no similar runs, merge just enough of the newest ones to get back to max_runs
+            width = runs.size() - max_runs + 1;
+        }
+    }
+
+    compaction.input_level = 1;
+    compaction.inputs.clear();
+    for (size_t i = 0; i < width; ++i) {
+        compaction.inputs.insert(compaction.inputs.end(), runs[i].tables.begin(), runs[i].tables.end());
+    }
+    compaction.output_level = 1;
+    compaction.overlapped.clear();
+    compaction.is_delete = width == runs.size() && level_count == 2;
+    return true;
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "Compression.h"
+
+namespace {
+    const size_t MIN_MATCH = 4;
+    // the last match starts at least MF_LIMIT bytes and ends LAST_LITERALS bytes before the end
+    const size_t MF_LIMIT = 12;
+    const size_t LAST_LITERALS = 5;
+    const size_t MAX_OFFSET = 65535;
+    const int HASH_BITS = 12;
+
+    uint32_t read32(const char *p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    uint32_t hash(uint32_t sequence) {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    void put_length(std::string &out, size_t length) {
+        while (length >= 255) {
+            out.push_back((char)255);
+            length -= 255;
+        }
+        out.push_back((char)length);
+    }
+
+    /**
+     * Append a sequence, match_length 0 for the trailing literals.
+     */
+    void put_sequence(std::string &out, const char *literals, size_t literal_length,
+                      size_t offset, size_t match_length) {
+        size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+        uint8_t token = (uint8_t)((std::min(literal_length, (size_t)15) << 4) |
+                                  std::min(match_code, (size_t)15));
+        out.push_back((char)token);
+        if (literal_length >= 15) put_length(out, literal_length - 15);
+        out.append(literals, literal_length);
+        if (!match_length) return;
+        out.push_back((char)(offset & 0xFF));
+        out.push_back((char)(offset >> 8));
+        if (match_code >= 15) put_length(out, match_code - 15);
+    }
+
+    bool get_length(const uint8_t *&in, const uint8_t *end, size_t &length) {
+        uint8_t byte;
+        do {
+            if (in >= end) return false;
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+}
+
+void compression::lz_compress(const char *data, size_t n, std::string &out) {
+    size_t anchor = 0, pos = 0;
+    if (n >= MF_LIMIT) {
+        std::vector<int64_t> table(1 << HASH_BITS, -1);
+        size_t match_end_limit = n - LAST_LITERALS;
+        size_t match_start_limit = n - MF_LIMIT;
+        while (pos <= match_start_limit) {
+            uint32_t sequence = read32(data + pos);
+            uint32_t h = hash(sequence);
+            int64_t candidate = table[h];
+            table[h] = (int64_t)pos;
+            if (candidate < 0 || pos - candidate > MAX_OFFSET || read32(data + candidate) != sequence) {
+                pos++;
+                continue;
+            }
+            size_t length = MIN_MATCH;
+            while (pos + length < match_end_limit && data[candidate + length] == data[pos + length]) {
+                length++;
+            }
+            put_sequence(out, data + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+        }
+    }
+    put_sequence(out, data + anchor, n - anchor, 0, 0);
+}
+
+bool compression::lz_decompress(const char *data, size_t n, char *out, size_t out_size) {
+    const uint8_t *in = (const uint8_t*)data, *end = in + n;
+    size_t written = 0;
+    while (in < end) {
+        uint8_t token = *in++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !get_length(in, end, literal_length)) return false;
+        if (literal_length > (size_t)(end - in) || literal_length > out_size - written) return false;
+        memcpy(out + written, in, literal_length);
+        in += literal_length;
+        written += literal_length;
+        // the last sequence has literals only
+        if (in == end) break;
+
+        if (end - in < 2) return false;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > written) return false;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !get_length(in, end, match_length)) return false;
+        match_length += MIN_MATCH;
+        if (match_length > out_size - written) return false;
+        const char *match = out + written - offset;
+        if (offset >= match_length) {
+            memcpy(out + written, match, match_length);
+        } else {
+            // overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < match_length; ++i) out[written + i] = match[i];
+        }
+        written += match_length;
+    }
+    return written == out_size;
+}
@@ -1,12 +1,29 @@
 #include "DiskRepo.h"
 #include "utils.h"
 #include <iostream>
+#include <chrono>
+#include <algorithm>
 
-DiskRepo::DiskRepo(const std::string& d): time_stamp(1), dir(d) {
+// backoff of compactions after failed writes, from the first retry to the longest wait
+static const uint64_t MIN_RETRY_MS = 100;
+static const uint64_t MAX_RETRY_MS = 10000;
+
+DiskRepo::DiskRepo(const std::string& d, const Options &options):
+    time_stamp(1), dir(d),
+    slowdown_trigger(options.level0_slowdown_trigger),
+    // level-0 is compacted only above 2 tables, a lower stop trigger would never release
+    stop_trigger(std::max(options.level0_stop_trigger, (size_t)3)),
+    block_cache(options.block_cache_capacity ? new BlockCache(options.block_cache_capacity) : nullptr),
+    table_cache(std::make_shared<TableCache>(options)),
+    table_options(options), xor_filter_level(options.xor_filter_level),
+    compaction_readahead(options.compaction_readahead),
+    max_subcompactions(std::max(options.max_subcompactions, (size_t)1)),
+    picker(CompactionPicker::create(options)), table_probes(0), read_errors(0) {
     if (!utils::dirExists(dir)) {
         utils::mkdir(d.c_str());
     } else {
         // read data from existing SSTable
+        auto recovered = std::make_shared<Version>();
         std::vector<std::string> dir_list;
         utils::scanDir(d, dir_list);
         for (size_t i = 0; ; ++i) {
@@ -15,10 +32,10 @@ DiskRepo::DiskRepo(const std::string& d): time_stamp(1), dir(d) {
             while (dir_str != dir_list.end()) {
                 if (cur_match_name == (*dir_str)) { // hit!
                     // scan all files in current level
-                    auto new_level = new Level(dir, i);
-                    uint64_t max_ts = new_level->scan_level();
+                    Level new_level(dir, i);
+                    uint64_t max_ts = new_level.scan_level(table_cache);
                     if (time_stamp <= max_ts) time_stamp = max_ts;
-                    disk_levels.push_back(new_level);
+                    recovered->add_level(new_level);
                     break;
                 }
                 dir_str++;
@@ -26,140 +43,277 @@ DiskRepo::DiskRepo(const std::string& d): time_stamp(1), dir(d) {
             if (dir_str == dir_list.end()) break;
         }
         time_stamp++;
+        versions.install(recovered);
     }
+    // levels left overflowed by the last run are compacted at once
+    compaction_thread = std::thread(&DiskRepo::compaction_loop, this);
 }
 
 DiskRepo::~DiskRepo() {
-    for (auto level : disk_levels) {
-        delete level;
+    {
+        std::lock_guard<std::mutex> lock(repo_mutex);
+        stopping = true;
     }
+    compaction_cv.notify_all();
+    compaction_thread.join();
 }
 
-void DiskRepo::create_level(uint64_t ls) {
+void DiskRepo::create_level(Version &edit, uint64_t ls) {
     std::string level_str = dir + "/level-" + my_itoa(ls);
     utils::mkdir(level_str.c_str());
-    disk_levels.push_back(new Level(dir, ls));
+    // tables synced into the level are lost with it unless its entry is durable too
+    utils::syncPath(dir.c_str(), true);
+    edit.add_level(Level(dir, ls));
 }
 
-void DiskRepo::handle_overflow(size_t overflowed_index) {
-    Level *upper_level = disk_levels[overflowed_index];
-    std::vector<SSTable*> overflowed_tables;
+void DiskRepo::run_compaction(std::unique_lock<std::mutex> &lock, Compaction &compaction) {
+    version_ptr base = versions.current();
 
-    if (overflowed_index == 0) { // pop SSTable out to prepare for merging
-        // level-0: compact all
-        overflowed_tables = upper_level->pop_k(upper_level->get_size());
-    } else {
-        // not level-0
-        size_t merge_num = upper_level->get_size() - (1 << (overflowed_index + 1));
-        overflowed_tables = upper_level->pop_k(merge_num);
+    if (compaction.output_level == base->level_count()) { // next dir doesn't exists
+        auto edit = std::make_shared<Version>(*base);
+        create_level(*edit, compaction.output_level);
+        versions.install(edit);
+        base = edit;
     }
 
-    if (overflowed_index == disk_levels.size() - 1) { // next dir doesn't exists
-        create_level(overflowed_index + 1);
-    }
+    auto level_path = base->get_level(compaction.output_level).get_level_path();
 
-    Level *next_level = disk_levels[overflowed_index + 1];
-    // merge a table from upper level at once => maybe faster
+    std::vector<table_ptr> prepared_data(compaction.inputs);
+    prepared_data.insert(prepared_data.end(), compaction.overlapped.begin(), compaction.overlapped.end());
 
-    scope_type overflow_scope = std::make_pair(UINT64_MAX, 0);
+    // only this thread removes tables, so inputs are still in the latest Version after merging
+    TableOptions merge_options = table_options;
+    merge_options.xor_filter = xor_filter_level && compaction.output_level >= xor_filter_level;
 
-    for (auto cur_table : overflowed_tables) {
-        auto cur_scope = cur_table->get_scope();
-        if (cur_scope.first < overflow_scope.first)
-            overflow_scope.first = cur_scope.first;
-        if (cur_scope.second > overflow_scope.second)
-            overflow_scope.second = cur_scope.second;
-    }
+    // upper level data may be older than tables already pushed into next level, so merged
+    // tables take a new time stamp: newest in their level even if a crash leaves inputs there
+    uint64_t merge_ts = time_stamp++;
 
-    auto level_path = next_level->get_level_path();
-    auto next_lv_map = next_level->get_level();
+    compacting = true;
+    lock.unlock();
+    std::vector<SSTable*> merged;
+    Status status = merge_ranges(prepared_data, compaction.is_delete, level_path, merge_options, merge_ts, merged);
+    lock.lock();
 
-    auto find_itr = next_lv_map->begin();
-    std::vector<std::map<key_type, SSTable*>::iterator> del_record;
-    while (find_itr != next_lv_map->end()) {
-        auto cur_table = find_itr->second;
-        if (overflow_scope.second >= cur_table->get_scope().first &&
-            overflow_scope.first <= cur_table->get_scope().second) {
-            del_record.push_back(find_itr);
-            overflowed_tables.push_back(cur_table);
+    if (status == Status::CORRUPTION) {
+        // inputs are kept as they are, retrying would fail the same way
+        fprintf(stderr, "DiskRepo: compaction of level-%zu stopped, an SSTable is corrupted\n",
+                compaction.input_level);
+        compaction_failed = true;
+    } else if (status != Status::OK) {
+        // the disk may be full for a while, inputs are merged again later
+        compaction_retry_ms = std::min(std::max(compaction_retry_ms * 2, MIN_RETRY_MS), MAX_RETRY_MS);
+        fprintf(stderr, "DiskRepo: compaction of level-%zu failed to write an SSTable, retrying in %llu ms\n",
+                compaction.input_level, (unsigned long long)compaction_retry_ms);
+    } else {
+        compaction_retry_ms = 0;
+        // flushes may have installed Versions meanwhile, so edit the latest one
+        auto edit = std::make_shared<Version>(*versions.current());
+        edit->edit_level(compaction.input_level).erase(compaction.inputs);
+        edit->edit_level(compaction.output_level).erase(compaction.overlapped);
+        for (auto insert : merged) {
+            edit->edit_level(compaction.output_level).push_back(table_ptr(insert));
         }
-        find_itr++;
+        // fences are rebuilt once for the whole edit
+        edit->edit_level(compaction.input_level).finalize();
+        edit->edit_level(compaction.output_level).finalize();
+        for (size_t i = 0; i < prepared_data.size(); ++i) {
+            // newest first, so files go oldest first
+            prepared_data[i]->mark_obsolete(i ? prepared_data[i - 1] : nullptr);
+        }
+        versions.install(edit);
     }
+    compacting = false;
+    installed_cv.notify_all();
 
-    for (auto del_itr : del_record) {
-        next_lv_map->erase(del_itr);
-    }
+    // inputs unreferenced by readers have their files deleted here, outside the lock
+    lock.unlock();
+    base.reset();
+    prepared_data.clear();
+    compaction.inputs.clear();
+    compaction.overlapped.clear();
+    lock.lock();
+}
 
-    // if next level is the bottom, delete all "~DELETED~" flags
-    bool is_delete = overflowed_index == disk_levels.size() - 2;
-    auto merged = merge_table(overflowed_tables, is_delete, level_path);
+Status DiskRepo::merge_ranges(const std::vector<table_ptr> &prepared_data, bool is_delete,
+                              const std::string &dir, const TableOptions &options,
+                              uint64_t merge_ts, std::vector<SSTable*> &merged) {
+    size_t range_count = std::min(max_subcompactions, std::max(prepared_data.size() / 2, (size_t)1));
+
+    // ranges start at table boundaries, spread evenly over them
+    std::vector<uint64_t> starts{0};
+    if (range_count > 1) {
+        std::vector<uint64_t> bounds;
+        for (auto &table : prepared_data) {
+            scope_type scope = table->get_scope();
+            bounds.push_back(scope.first);
+            if (scope.second < UINT64_MAX) bounds.push_back(scope.second + 1);
+        }
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+        for (size_t i = 1; i < range_count && bounds.size() > 1; ++i) {
+            // the smallest bound begins the first range already
+            uint64_t start = bounds[1 + i * (bounds.size() - 1) / range_count];
+            if (start > starts.back()) starts.push_back(start);
+        }
+    }
 
-    for (auto insert : merged) {
-        next_level->push_back(insert);
+    std::vector<std::vector<SSTable*>> outputs(starts.size());
+    std::vector<Status> statuses(starts.size());
+    size_t readahead = compaction_readahead / starts.size();
+    auto merge_range = [&](size_t i) {
+        uint64_t end = i + 1 < starts.size() ? starts[i + 1] - 1 : UINT64_MAX;
+        statuses[i] = merge_table(prepared_data, is_delete, dir, options, merge_ts, readahead,
+                                  starts[i], end, table_cache, outputs[i]);
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < starts.size(); ++i) {
+        workers.emplace_back(merge_range, i);
+    }
+    merge_range(0);
+    for (auto &worker : workers) {
+        worker.join();
     }
 
+    Status status = Status::OK;
+    for (auto range_status : statuses) {
+        if (status == Status::OK) status = range_status;
+    }
+    merged.clear();
+    for (auto &output : outputs) {
+        if (status == Status::OK) {
+            merged.insert(merged.end(), output.begin(), output.end());
+            continue;
+        }
+        // the whole compaction is given up, so are the ranges merged fine
+        for (auto cur_table : output) {
+            cur_table->mark_obsolete();
+            delete cur_table;
+        }
+    }
+    return status;
 }
 
-bool DiskRepo::check_overflow(size_t index) {
-    if (index >= disk_levels.size()) return true;
-    return disk_levels[index]->get_size() <= (size_t)(1 << (index + 1));
+void DiskRepo::compaction_loop() {
+    std::unique_lock<std::mutex> lock(repo_mutex);
+    while (true) {
+        if (compaction_retry_ms) {
+            compaction_cv.wait_for(lock, std::chrono::milliseconds(compaction_retry_ms), [this] { return stopping; });
+        }
+        Compaction compaction;
+        compaction_cv.wait(lock, [&] {
+            return stopping || (!compaction_failed && picker->pick(*versions.current(), compaction));
+        });
+        if (stopping) break;
+        run_compaction(lock, compaction);
+    }
 }
 
-void DiskRepo::push_ssTable(SSTable *new_table) {
-    disk_levels[0]->push_back(new_table);
-    size_t cur_level = 0;
-    while (!check_overflow(cur_level)) {
-        // overflow -> compaction
-        handle_overflow(cur_level);
-        cur_level++;
-    }
+void DiskRepo::push_ssTable(const table_ptr &new_table) {
+    auto edit = std::make_shared<Version>(*versions.current());
+    edit->edit_level(0).push_back(new_table);
+    edit->edit_level(0).finalize();
+    versions.install(edit);
+    // the picker tells if a compaction is due
+    compaction_cv.notify_all();
 }
 
-void DiskRepo::push_ssTable(ListNode *head, uint64_t kv_count) {
-    if (!kv_count) return;
+bool DiskRepo::push_ssTable(SkipList *memTable) {
+    if (!memTable->get_kv_count()) return true;
 
-    if (disk_levels.empty()) {
-        create_level(0);
+    std::unique_lock<std::mutex> lock(repo_mutex);
+    if (!versions.current()->level_count()) {
+        auto edit = std::make_shared<Version>();
+        create_level(*edit, 0);
+        versions.install(edit);
     }
+    auto level0_size = [this] { return versions.current()->get_level(0).get_size(); };
+    // level-0 is searched by every get, keep it from growing without bound
+    bool slowdown = level0_size() >= slowdown_trigger;
+    // level-0 no longer shrinks once a table is found corrupted, keep taking flushes (still slowed
+    // down) rather than hang. While failed writes are retried, flushes wait for level-0 to shrink.
+    installed_cv.wait(lock, [&] { return level0_size() < stop_trigger || compaction_failed; });
+    uint64_t cur_ts = time_stamp++;
+    lock.unlock();
 
-    auto new_ssTable = new SSTable(head, kv_count, time_stamp++, dir + "/level-0");
+    if (slowdown) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto new_ssTable = std::make_shared<SSTable>(*memTable, cur_ts, dir + "/level-0", table_options, table_cache);
+    if (!new_ssTable->is_durable()) {
+        // the file may have got its name before the directory failed to sync, and would
+        // come back at restart as the newest table of level-0, shadowing newer data below
+        new_ssTable->mark_obsolete();
+        return false;
+    }
+
+    lock.lock();
     push_ssTable(new_ssTable);
+    return true;
 }
 
-void DiskRepo::push_table(SkipList *memTable) {
-    ListNode *head = memTable->get_bottom_head();
-    uint64_t kv_count = memTable->get_kv_count();
-    push_ssTable(head, kv_count);
+bool DiskRepo::push_table(SkipList *memTable) {
+    return push_ssTable(memTable);
 }
 
 std::string DiskRepo::get(uint64_t key) {
-    std::string ret_string;
-    uint64_t max_time_stamp = 0;
-    for (auto cur_level : disk_levels) {
-        uint64_t cur_ts = 0;
-        std::string cur_str = cur_level->get(key, cur_ts);
-        if (cur_ts > max_time_stamp) {
-            ret_string = cur_str;
-            max_time_stamp = cur_ts;
-        }
+    PinnedValue value;
+    return get(key, value) == Status::OK ? value.release() : "";
+}
+
+Status DiskRepo::get(uint64_t key, PinnedValue &value) {
+    size_t probes = 0;
+    Status status = versions.current()->get(key, value, block_cache.get(), probes);
+    table_probes.fetch_add(probes, std::memory_order_relaxed);
+    if (status == Status::CORRUPTION) {
+        read_errors.fetch_add(1, std::memory_order_relaxed);
+        fprintf(stderr, "DiskRepo: key %llu can't be read, its table is corrupted\n", (unsigned long long)key);
+    }
+    if (status != Status::OK || value.value() == "~DELETED~") {
+        value.reset();
+        return status == Status::OK ? Status::NOT_FOUND : status;
     }
-    return ret_string == "~DELETED~" ? "" : ret_string;
+    return Status::OK;
+}
+
+const BlockCache *DiskRepo::get_block_cache() const {
+    return block_cache.get();
+}
+
+uint64_t DiskRepo::get_table_probes() const {
+    return table_probes;
+}
+
+uint64_t DiskRepo::get_read_errors() const {
+    return read_errors;
+}
+
+void DiskRepo::add_iterators(std::vector<std::unique_ptr<Iterator>> &iters, uint64_t start, uint64_t end) {
+    versions.current()->add_iterators(iters, start, end);
 }
 
 void DiskRepo::clear() {
-    for (auto del_level : disk_levels) {
-        del_level->delete_level();
+    std::unique_lock<std::mutex> lock(repo_mutex);
+    installed_cv.wait(lock, [this] { return !compacting; });
+    version_ptr old_version = versions.current();
+    std::vector<std::string> level_paths;
+    for (size_t index = 0; index < old_version->level_count(); ++index) {
+        Level del_level = old_version->get_level(index);
+        del_level.delete_level();
+        level_paths.push_back(del_level.get_level_path());
+    }
+    versions.install(std::make_shared<Version>());
+    // files are gone unless a reader still holds old_version
+    old_version.reset();
+    for (auto &level_path : level_paths) {
+        utils::rmdir(level_path.c_str());
     }
-    disk_levels.clear();
     time_stamp = 1;
+    // the corrupted tables are gone with the rest
+    compaction_failed = false;
+    compaction_retry_ms = 0;
 }
 
 bool DiskRepo::check_overlap() {
-    auto level = disk_levels.begin() + 1;
-    while (level != disk_levels.end()) {
-        if (!(*level)->check_overlap())
-            return false;
-        level++;
-    }
-    return true;
+    return versions.current()->check_overlap();
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include "FileCache.h"
+
+FileCache::File::~File() {
+    close(fd);
+}
+
+FileCache::FileCache(size_t c): capacity(c ? c : 1) {}
+
+void FileCache::evict() {
+    while (lru.size() > capacity) {
+        files.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+FileCache::file_ptr FileCache::open(uint64_t id, const std::string &path) {
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto found = files.find(id);
+        if (found != files.end()) {
+            lru.splice(lru.begin(), lru, found->second);
+            return found->second->second;
+        }
+    }
+
+    // open outside the lock, other files stay readable meanwhile
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    auto opened = std::make_shared<const File>(fd);
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto found = files.find(id);
+    if (found != files.end()) {
+        // another reader opened it first, ours is closed on return
+        lru.splice(lru.begin(), lru, found->second);
+        return found->second->second;
+    }
+    lru.emplace_front(id, opened);
+    files[id] = lru.begin();
+    evict();
+    return opened;
+}
+
+void FileCache::erase(uint64_t id) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto found = files.find(id);
+    if (found != files.end()) {
+        lru.erase(found->second);
+        files.erase(found);
+    }
+}
@@ -0,0 +1,45 @@
+#include "KVIterator.h"
+
+KVIterator::KVIterator(std::vector<std::shared_ptr<SkipList>> mems,
+                       std::vector<std::unique_ptr<Iterator>> srcs):
+    mem_tables(std::move(mems)), merged(new MergingIterator(std::move(srcs), true)) {}
+
+bool KVIterator::valid() const {
+    return merged->valid();
+}
+
+void KVIterator::seek_to_first() {
+    merged->seek_to_first();
+}
+
+void KVIterator::seek_to_last() {
+    merged->seek_to_last();
+}
+
+void KVIterator::seek(uint64_t key) {
+    merged->seek(key);
+}
+
+void KVIterator::seek_for_prev(uint64_t key) {
+    merged->seek_for_prev(key);
+}
+
+void KVIterator::next() {
+    merged->next();
+}
+
+void KVIterator::prev() {
+    merged->prev();
+}
+
+uint64_t KVIterator::key() const {
+    return merged->key();
+}
+
+Slice KVIterator::value() const {
+    return merged->value();
+}
+
+Status KVIterator::status() const {
+    return merged->status();
+}
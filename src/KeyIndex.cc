@@ -0,0 +1,73 @@
+#include "KeyIndex.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KEY_INDEX_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define KEY_INDEX_PREFETCH(addr)
+#endif
+
+KeyIndex::KeyIndex(std::vector<uint64_t> k): keys(std::move(k)) {
+    size_t leaves = (keys.size() + LEAF_SIZE - 1) / LEAF_SIZE;
+    tree.resize(leaves + 1);
+    tree_leaf.resize(leaves + 1);
+    size_t leaf = 0;
+    build(1, leaf);
+}
+
+void KeyIndex::build(size_t k, size_t &leaf) {
+    if (k >= tree.size()) return;
+    build(2 * k, leaf);
+    tree[k] = keys[leaf * LEAF_SIZE];
+    tree_leaf[k] = (uint32_t)leaf++;
+    build(2 * k + 1, leaf);
+}
+
+size_t KeyIndex::size() const {
+    return keys.size();
+}
+
+uint64_t KeyIndex::operator[](size_t i) const {
+    return keys[i];
+}
+
+size_t KeyIndex::lower_bound(uint64_t key) const {
+    size_t n = keys.size();
+    if (n == 0) return 0;
+
+    // descend to the first leaf starting with a key >= key,
+    // fetching the 8 descendants 3 levels down (one cache line) meanwhile
+    size_t m = tree.size() - 1;
+    size_t k = 1;
+    while (k <= m) {
+        if (8 * k < tree.size()) KEY_INDEX_PREFETCH(tree.data() + 8 * k);
+        k = 2 * k + (tree[k] < key);
+    }
+    // undo the right turns taken after the last left one
+    while (k & 1) k >>= 1;
+    k >>= 1;
+
+    size_t leaf;
+    if (k == 0) {
+        // every leaf starts below key
+        leaf = m - 1;
+    } else {
+        if (tree_leaf[k] == 0) return 0;
+        leaf = tree_leaf[k] - 1;
+    }
+
+    // key is placed inside the previous leaf, or at the start of the found one
+    size_t first = leaf * LEAF_SIZE;
+    const uint64_t *cur = keys.data() + first;
+    size_t count = 0;
+    if (first + LEAF_SIZE <= n) {
+        for (size_t i = 0; i < LEAF_SIZE; ++i) count += cur[i] < key;
+    } else {
+        for (size_t i = 0; i < n - first; ++i) count += cur[i] < key;
+    }
+    return first + count;
+}
+
+size_t KeyIndex::find(uint64_t key) const {
+    size_t pos = lower_bound(key);
+    return (pos < keys.size() && keys[pos] == key) ? pos : keys.size();
+}
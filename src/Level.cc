@@ -1,13 +1,14 @@
 #include <queue>
 #include <cstdlib>
+#include <algorithm>
 #include "Level.h"
 #include "utils.h"
 
-Level::Level(const std::string& dir, size_t l) {
+Level::Level(const std::string& dir, size_t l): level_bytes(0), level_number(l), disjoint(l > 0) {
     level_path = dir + "/level-" + my_itoa(l);
 }
 
-uint64_t Level::scan_level() {
+uint64_t Level::scan_level(const std::shared_ptr<TableCache> &cache) {
     std::vector<std::string> dir_list;
     utils::scanDir(level_path, dir_list);
     uint64_t max_ts = 0;
@@ -18,88 +19,156 @@ uint64_t Level::scan_level() {
             uint64_t cur_id = std::stoll(file_str.substr(0, last_index));
             if (cur_id >= SSTable::table_id) SSTable::table_id = cur_id + 1;
             // if end with .sst, add to level storage
-            auto new_ssTable = new SSTable(level_path + "/" + file_str);
+            auto new_ssTable = std::make_shared<SSTable>(level_path + "/" + file_str, cache);
             if (new_ssTable->get_time_stamp() > max_ts) {
                 // get the max time stamp
                 max_ts = new_ssTable->get_time_stamp();
             }
             push_back(new_ssTable);
+        } else if (file_str.size() > 4 && file_str.compare(file_str.size() - 4, 4, ".tmp") == 0) {
+            // table being written when the process died
+            utils::rmfile((level_path + "/" + file_str).c_str());
         }
     }
+    finalize();
     return max_ts;
 }
 
-Level::~Level() {
-    for (auto del_table : level_tables) {
-        delete del_table.second;
+void Level::push_back(const table_ptr &new_ssTable) {
+    key_type table_key = std::make_pair(new_ssTable->get_time_stamp(), new_ssTable->get_scope().first);
+    if (level_tables.insert(std::make_pair(table_key, new_ssTable)).second) {
+        level_bytes += new_ssTable->get_raw_size();
     }
 }
 
-void Level::push_back(SSTable* new_ssTable) {
-    key_type table_key = std::make_pair(new_ssTable->get_time_stamp(), new_ssTable->get_scope().first);
-    level_tables.insert(std::make_pair(table_key, new_ssTable));
+void Level::finalize() {
+    if (level_number == 0) return;
+    fence_tables.clear();
+    for (auto &table : level_tables) {
+        fence_tables.push_back(table.second);
+    }
+    std::sort(fence_tables.begin(), fence_tables.end(), [](const table_ptr &a, const table_ptr &b) {
+        return a->get_scope().first < b->get_scope().first;
+    });
+    std::vector<uint64_t> max_keys;
+    max_keys.reserve(fence_tables.size());
+    disjoint = true;
+    for (auto &table : fence_tables) {
+        if (!max_keys.empty() && table->get_scope().first <= max_keys.back()) disjoint = false;
+        max_keys.push_back(table->get_scope().second);
+    }
+    fence_keys = KeyIndex(std::move(max_keys));
 }
 
-size_t Level::get_size() {
+size_t Level::get_size() const {
     return level_tables.size();
 }
 
-std::vector<SSTable*> Level::pop_k(size_t k) {
+uint64_t Level::get_bytes() const {
+    return level_bytes;
+}
+
+std::vector<table_ptr> Level::first_k(size_t k) const {
 
-    std::vector<SSTable*> selected_tables;
-    for (size_t ind = 0; ind < k; ++ind) {
-        SSTable *popped = level_tables.begin()->second;
-        selected_tables.push_back(popped);
-        level_tables.erase(level_tables.begin());
+    std::vector<table_ptr> selected_tables;
+    auto select_itr = level_tables.begin();
+    for (size_t ind = 0; ind < k && select_itr != level_tables.end(); ++ind) {
+        selected_tables.push_back(select_itr->second);
+        select_itr++;
     }
     return selected_tables;
 }
 
-std::string Level::get(uint64_t key, uint64_t &ret_ts) {
-    std::string ret_string;
+bool Level::is_disjoint() const {
+    return disjoint;
+}
+
+const std::vector<table_ptr> &Level::sorted_tables() const {
+    return fence_tables;
+}
+
+std::vector<table_ptr> Level::overlapping(scope_type scope) const {
+    std::vector<table_ptr> tables;
+    if (disjoint) {
+        // tables from the first one ending at or after scope begins, till one begins after it
+        for (size_t index = fence_keys.lower_bound(scope.first);
+             index < fence_tables.size() && fence_tables[index]->get_scope().first <= scope.second; ++index) {
+            tables.push_back(fence_tables[index]);
+        }
+        return tables;
+    }
+    // merges take earlier inputs as newer, so bigger time stamp first
+    for (auto find_itr = level_tables.rbegin(); find_itr != level_tables.rend(); ++find_itr) {
+        scope_type cur_scope = find_itr->second->get_scope();
+        if (scope.second >= cur_scope.first && scope.first <= cur_scope.second) {
+            tables.push_back(find_itr->second);
+        }
+    }
+    return tables;
+}
+
+void Level::erase(const std::vector<table_ptr> &tables) {
+    for (auto &table : tables) {
+        if (level_tables.erase(std::make_pair(table->get_time_stamp(), table->get_scope().first))) {
+            level_bytes -= table->get_raw_size();
+        }
+    }
+}
+
+Status Level::get(uint64_t key, PinnedValue &value, BlockCache *cache, size_t &probes) const {
+    if (disjoint) {
+        // only the first table ending at or after key may hold it
+        size_t index = fence_keys.lower_bound(key);
+        if (index == fence_tables.size()) return Status::NOT_FOUND;
+        SSTable *cur_tb = fence_tables[index].get();
+        if (!in_scope(cur_tb->get_scope(), key)) return Status::NOT_FOUND;
+        ++probes;
+        // may be "~DELETED~"
+        Status status = cur_tb->get(key, value, cache);
+        return status == Status::OK && !value.size() ? Status::NOT_FOUND : status;
+    }
+
     auto find_itr = level_tables.rbegin();
     // find from tables with bigger time stamp
     while (find_itr != level_tables.rend()) {
-        SSTable *cur_tb = find_itr->second;
+        SSTable *cur_tb = find_itr->second.get();
         if (in_scope(cur_tb->get_scope(), key)) {
-            std::string tmp_string = cur_tb->get(key);
-            if (!tmp_string.empty()) {
-                ret_ts = cur_tb->get_time_stamp();
-                return tmp_string; // may be "~DELETED~"
-            } else if (level_tables.size() > 2) {
-                // if not in the level-0, data overlap is forbidden
-                return "";
+            ++probes;
+            Status status = cur_tb->get(key, value, cache);
+            if (status == Status::CORRUPTION || (status == Status::OK && value.size())) {
+                return status; // may be "~DELETED~"
             }
         }
         find_itr++;
     }
-    return "";
+    return Status::NOT_FOUND;
 }
 
 void Level::delete_level() {
-    for (auto del_table : level_tables) {
-        del_table.second->delete_file();
+    for (auto &del_table : level_tables) {
+        del_table.second->mark_obsolete();
     }
-    utils::rmdir(level_path.c_str());
     level_tables.clear();
+    level_bytes = 0;
+    finalize();
 }
 
-std::string Level::get_level_path() {
+std::string Level::get_level_path() const {
     return level_path;
 }
 
-std::map<key_type, SSTable*> *Level::get_level() {
+const std::map<key_type, table_ptr> *Level::get_level() const {
     return &level_tables;
 }
 
-bool Level::check_overlap() {
-    std::map<uint64_t, SSTable*> sort_map;
-    for (auto itr : level_tables) {
+bool Level::check_overlap() const {
+    std::map<uint64_t, table_ptr> sort_map;
+    for (auto &itr : level_tables) {
         sort_map.insert(std::make_pair(itr.second->get_scope().first, itr.second));
     }
     uint64_t last_key = 0;
     const char *last_path = "null";
-    for (auto itr :sort_map) {
+    for (auto &itr :sort_map) {
         scope_type s = itr.second->get_scope();
         if (s.first <= last_key && last_key) {
             printf("overlap scope between %s and %s\n",last_path, itr.second->get_table_path().c_str());
@@ -110,4 +179,111 @@ bool Level::check_overlap() {
         last_path = itr.second->get_table_path().c_str();
     }
     return true;
-}
\ No newline at end of file
+}
+void Level::add_iterators(std::vector<std::unique_ptr<::Iterator>> &iters, uint64_t start, uint64_t end) const {
+    if (disjoint) {
+        iters.emplace_back(new Iterator(*this, start, end));
+        return;
+    }
+    // level-0 tables (or sorted runs) may overlap, bigger time stamp first
+    for (auto find_itr = level_tables.rbegin(); find_itr != level_tables.rend(); ++find_itr) {
+        if (find_itr->second->range_test(start, end)) {
+            iters.emplace_back(new SSTable::Iterator(find_itr->second));
+        }
+    }
+}
+
+Level::Iterator::Iterator(const Level &level, uint64_t start, uint64_t end): table_index(0) {
+    // fences are in key order already
+    for (auto &table : level.fence_tables) {
+        if (table->range_test(start, end)) tables.push_back(table);
+    }
+    table_index = tables.size();
+}
+
+void Level::Iterator::open_table(size_t index) {
+    if (read_status == Status::OK && table_itr) read_status = table_itr->status();
+    table_index = index;
+    if (index < tables.size()) {
+        table_itr.reset(new SSTable::Iterator(tables[index]));
+    } else {
+        table_itr.reset();
+    }
+}
+
+void Level::Iterator::skip_forward() {
+    while (table_itr && !table_itr->valid() && table_itr->status() == Status::OK &&
+           table_index + 1 < tables.size()) {
+        open_table(table_index + 1);
+        table_itr->seek_to_first();
+    }
+}
+
+void Level::Iterator::skip_backward() {
+    while (table_itr && !table_itr->valid() && table_itr->status() == Status::OK && table_index > 0) {
+        open_table(table_index - 1);
+        table_itr->seek_to_last();
+    }
+}
+
+bool Level::Iterator::valid() const {
+    return table_itr && table_itr->valid();
+}
+
+void Level::Iterator::seek_to_first() {
+    open_table(0);
+    if (table_itr) table_itr->seek_to_first();
+    skip_forward();
+}
+
+void Level::Iterator::seek_to_last() {
+    if (tables.empty()) return;
+    open_table(tables.size() - 1);
+    table_itr->seek_to_last();
+    skip_backward();
+}
+
+void Level::Iterator::seek(uint64_t key) {
+    // first table whose max_key >= key
+    auto found = std::lower_bound(tables.begin(), tables.end(), key,
+        [](const table_ptr &table, uint64_t k) { return table->get_scope().second < k; });
+    open_table(found - tables.begin());
+    if (table_itr) table_itr->seek(key);
+    skip_forward();
+}
+
+void Level::Iterator::seek_for_prev(uint64_t key) {
+    // last table whose min_key <= key
+    auto found = std::upper_bound(tables.begin(), tables.end(), key,
+        [](uint64_t k, const table_ptr &table) { return k < table->get_scope().first; });
+    if (found == tables.begin()) {
+        open_table(tables.size());
+        return;
+    }
+    open_table(found - tables.begin() - 1);
+    table_itr->seek_for_prev(key);
+    skip_backward();
+}
+
+void Level::Iterator::next() {
+    table_itr->next();
+    skip_forward();
+}
+
+void Level::Iterator::prev() {
+    table_itr->prev();
+    skip_backward();
+}
+
+uint64_t Level::Iterator::key() const {
+    return table_itr->key();
+}
+
+Slice Level::Iterator::value() {
+    return table_itr->value();
+}
+
+Status Level::Iterator::status() const {
+    if (read_status != Status::OK || !table_itr) return read_status;
+    return table_itr->status();
+}
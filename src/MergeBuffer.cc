@@ -1,52 +1,30 @@
 #include "MergeBuffer.h"
 
-MergeBuffer::MergeBuffer() {
-    head = new ListNode;
-    rear = head;
-}
-
-MergeBuffer::~MergeBuffer() {
-    delete_all();
-}
-
-bool MergeBuffer::push_back(uint64_t key, const std::string& value) {
-    uint64_t pred_length = data_total_length + value.size();
-    if (cal_size(data_count + 1, pred_length) > MAX_BYTE_SIZE)
+bool MergeBuffer::push_back(uint64_t key, Slice value) {
+    // a pair too large for any table (an empty memTable may still take it) gets one of its own
+    if (!keys.empty() && cal_size(keys.size() + 1, values.size() + value.size) > MAX_BYTE_SIZE)
         return false;
-    auto new_node = new ListNode(key, value);
-    new_node->insertAfterAbove(rear, nullptr);
-    rear = new_node;
-
-    data_count++;
-    data_total_length = pred_length;
+    keys.push_back(key);
+    offsets.push_back((uint32_t)values.size());
+    values.append(value.data, value.size);
     return true;
 }
 
-ListNode *MergeBuffer::get_head() {
-    return head;
+uint64_t MergeBuffer::key(size_t i) const {
+    return keys[i];
 }
 
-ListNode *MergeBuffer::get_rear() {
-    return rear;
+Slice MergeBuffer::value(size_t i) const {
+    size_t end = i + 1 < offsets.size() ? offsets[i + 1] : values.size();
+    return Slice(values.data() + offsets[i], end - offsets[i]);
 }
 
 uint64_t MergeBuffer::get_size() const {
-    return data_count;
+    return keys.size();
 }
 
 void MergeBuffer::clear() {
-    delete_all();
-    head = new ListNode;
-    rear = head;
+    keys.clear();
+    offsets.clear();
+    values.clear();
 }
-
-void MergeBuffer::delete_all() {
-    ListNode *cur_node = head;
-    while (cur_node) {
-        ListNode *del_node = cur_node;
-        cur_node = cur_node->next;
-        delete del_node;
-    }
-    data_count = 0;
-    data_total_length = 0;
-}
\ No newline at end of file
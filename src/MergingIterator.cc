@@ -0,0 +1,141 @@
+#include <algorithm>
+#include "MergingIterator.h"
+
+static const std::string deleted_flag = "~DELETED~";
+
+MergingIterator::MergingIterator(std::vector<std::unique_ptr<Iterator>> srcs, bool skip,
+                                 uint64_t start, uint64_t end):
+    sources(std::move(srcs)), heads(sources.size(), Head{false, 0}),
+    tree(std::max(sources.size(), (size_t)1), 0),
+    skip_deleted(skip), first_key(start), last_key(end) {}
+
+void MergingIterator::load(size_t source) {
+    Iterator *cur = sources[source].get();
+    heads[source].valid = cur->valid();
+    if (heads[source].valid) heads[source].key = cur->key();
+    if (read_status == Status::OK) read_status = cur->status();
+}
+
+bool MergingIterator::before(size_t a, size_t b) const {
+    const Head &x = heads[a], &y = heads[b];
+    if (!y.valid) return x.valid;
+    if (!x.valid) return false;
+    if (x.key != y.key) return forward ? x.key < y.key : x.key > y.key;
+    // the newest source of a key wins
+    return a < b;
+}
+
+size_t MergingIterator::build(size_t node) {
+    size_t k = sources.size();
+    if (node >= k) return node - k;
+    size_t left = build(node * 2), right = build(node * 2 + 1);
+    bool left_wins = before(left, right);
+    tree[node] = left_wins ? right : left;
+    return left_wins ? left : right;
+}
+
+void MergingIterator::rebuild() {
+    for (size_t i = 0; i < sources.size(); ++i) load(i);
+    if (!sources.empty()) tree[0] = build(1);
+}
+
+void MergingIterator::step(size_t source) {
+    Iterator *cur = sources[source].get();
+    if (forward) cur->next(); else cur->prev();
+    load(source);
+    size_t winner = source;
+    for (size_t node = (source + sources.size()) / 2; node > 0; node /= 2) {
+        if (before(tree[node], winner)) std::swap(tree[node], winner);
+    }
+    tree[0] = winner;
+}
+
+void MergingIterator::skip_key() {
+    // sources at cur_key win before any other key, newest first
+    while (!sources.empty() && heads[tree[0]].valid && heads[tree[0]].key == cur_key) {
+        step(tree[0]);
+    }
+}
+
+void MergingIterator::find_live() {
+    while (true) {
+        if (read_status != Status::OK || sources.empty() || !heads[tree[0]].valid) {
+            is_valid = false;
+            return;
+        }
+        size_t newest = tree[0];
+        cur_key = heads[newest].key;
+        if (forward ? cur_key > last_key : cur_key < first_key) {
+            is_valid = false;
+            return;
+        }
+        cur_value = sources[newest]->value();
+        // reading the value may fail too
+        load(newest);
+        if (read_status != Status::OK) continue;
+        if (!skip_deleted || !(cur_value == deleted_flag)) {
+            is_valid = true;
+            return;
+        }
+        skip_key();
+    }
+}
+
+bool MergingIterator::valid() const {
+    return is_valid;
+}
+
+void MergingIterator::seek_to_first() {
+    seek(first_key);
+}
+
+void MergingIterator::seek_to_last() {
+    seek_for_prev(last_key);
+}
+
+void MergingIterator::seek(uint64_t key) {
+    for (auto &source : sources) source->seek(std::max(key, first_key));
+    forward = true;
+    rebuild();
+    find_live();
+}
+
+void MergingIterator::seek_for_prev(uint64_t key) {
+    for (auto &source : sources) source->seek_for_prev(std::min(key, last_key));
+    forward = false;
+    rebuild();
+    find_live();
+}
+
+void MergingIterator::next() {
+    if (!forward) {
+        // sources behind cur_key are moved to it first
+        for (auto &source : sources) source->seek(cur_key);
+        forward = true;
+        rebuild();
+    }
+    skip_key();
+    find_live();
+}
+
+void MergingIterator::prev() {
+    if (forward) {
+        for (auto &source : sources) source->seek_for_prev(cur_key);
+        forward = false;
+        rebuild();
+    }
+    skip_key();
+    find_live();
+}
+
+uint64_t MergingIterator::key() const {
+    return cur_key;
+}
+
+Slice MergingIterator::value() {
+    return cur_value;
+}
+
+Status MergingIterator::status() const {
+    return read_status;
+}
@@ -0,0 +1,69 @@
+#include "PinnedValue.h"
+
+PinnedValue::PinnedValue(): slice(), owned(false) {}
+
+PinnedValue::PinnedValue(PinnedValue &&other) noexcept: slice(), owned(false) {
+    *this = std::move(other);
+}
+
+PinnedValue &PinnedValue::operator=(PinnedValue &&other) noexcept {
+    if (this == &other) return *this;
+    owned = other.owned;
+    owner = std::move(other.owner);
+    if (owned) {
+        // slice of other points into its buffer, which may move with SSO
+        buffer = std::move(other.buffer);
+        slice = Slice(buffer);
+    } else {
+        slice = other.slice;
+    }
+    other.reset();
+    return *this;
+}
+
+void PinnedValue::pin(Slice data, std::shared_ptr<const void> o) {
+    owner = std::move(o);
+    slice = data;
+    owned = false;
+}
+
+char *PinnedValue::own(size_t size) {
+    owner.reset();
+    buffer.resize(size);
+    slice = Slice(buffer);
+    owned = true;
+    return &buffer[0];
+}
+
+void PinnedValue::reset() {
+    owner.reset();
+    buffer.clear();
+    slice = Slice();
+    owned = false;
+}
+
+Slice PinnedValue::value() const {
+    return slice;
+}
+
+const char *PinnedValue::data() const {
+    return slice.data;
+}
+
+size_t PinnedValue::size() const {
+    return slice.size;
+}
+
+bool PinnedValue::is_pinned() const {
+    return owner != nullptr;
+}
+
+std::string PinnedValue::to_string() const {
+    return slice.to_string();
+}
+
+std::string PinnedValue::release() {
+    std::string ret = owned ? std::move(buffer) : slice.to_string();
+    reset();
+    return ret;
+}
@@ -1,197 +1,497 @@
 #include <fstream>
 #include <cstring>
-#include <queue>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include "SSTable.h"
 #include "MurmurHash3.h"
+#include "Compression.h"
 #include "utils.h"
+#include "MergingIterator.h"
+
+std::atomic<uint64_t> SSTable::table_id(0);
+std::atomic<uint64_t> SSTable::next_cache_id(0);
+
+TableOptions::TableOptions(const Options &options):
+    format_version(options.table_format_version),
+    block_size(options.table_block_size),
+    compression(options.table_compression),
+    partition_index(options.partition_index),
+    index_partition_size(options.index_partition_size),
+    filter_bits_per_key(options.filter_bits_per_key),
+    xor_filter(false),
+    range_filter_bits_per_prefix(options.range_filter_bits_per_prefix),
+    range_filter_shift(options.range_filter_shift) {}
+
+SSTable::Header::Header(): time_stamp(0), kv_count(0), min_key(0), max_key(0), version(LEGACY_FORMAT), flags(0) {}
+
+SSTable::Header::Header(uint64_t ts, uint64_t kc, uint64_t min, uint64_t max, uint32_t v, uint32_t f):
+    time_stamp(ts), kv_count(kc), min_key(min), max_key(max), version(v), flags(f) {}
+
+namespace {
+    /* ----- Fixed-size bloom filter of format 1 ----- */
+    void legacy_filter_add(char *filter, uint64_t key) {
+        uint32_t hash[4] = {0};
+        MurmurHash3_x64_128(&key, sizeof(key), 1, hash);
+        for (uint32_t h : hash) {
+            size_t bit = h % FILTER_BIT_SIZE;
+            filter[bit >> 3] |= (char)(1 << (bit & 7));
+        }
+    }
 
-uint64_t SSTable::table_id = 0;
-
-SSTable::Header::Header(): time_stamp(0), kv_count(0), min_key(0), max_key(0) {}
-
-SSTable::Header::Header(uint64_t ts, uint64_t kc, uint64_t min, uint64_t max):
-    time_stamp(ts), kv_count(kc), min_key(min), max_key(max) {}
-
-SSTable::IndexData::IndexData(): key(0), offset(0) {}
-
-SSTable::IndexData::IndexData(uint64_t k, uint32_t o): key(k), offset(o) {}
+    bool legacy_may_contain(const char *filter, uint64_t key) {
+        uint32_t hash[4] = {0};
+        MurmurHash3_x64_128(&key, sizeof(key), 1, hash);
+        for (uint32_t h : hash) {
+            size_t bit = h % FILTER_BIT_SIZE;
+            if (!((filter[bit >> 3] >> (bit & 7)) & 1)) return false;
+        }
+        return true;
+    }
 
-void SSTable::bitset_to_bytes(char *buf) {
-    memset(buf, 0, FILTER_BYTE_SIZE);
-    for (size_t index = 0; index < FILTER_BIT_SIZE; ++index) {
-        buf[index >> 3] |= (bloom_filter[index] << (index & 7));
+    /**
+     * Older builds hashed every key to 0 (MurmurHash3 output was read through an
+     * aliased pointer), leaving only bit 0 set. Such a filter can't rule any key out.
+     */
+    bool legacy_filter_broken(const std::string &filter) {
+        if (filter.empty() || filter[0] != 1) return false;
+        return filter.find_first_not_of('\0', 1) == std::string::npos;
     }
 }
 
-void SSTable::bitset_from_bytes(const char* buf) {
-    for (size_t index = 0; index < FILTER_BIT_SIZE; ++index) {
-        bloom_filter[index] = ((buf[index >> 3] >> (index & 7)) & 1);
-    }
+bool SSTable::filter_test(const char *bytes, size_t size, uint64_t key) const {
+    if (table_header.flags & XOR_FILTER) return xor_filter::may_contain(bytes, size, key);
+    if (table_header.flags & BLOCKED_FILTER) return bloom::may_contain(bytes, size, key);
+    return size != FILTER_BYTE_SIZE || legacy_may_contain(bytes, key);
 }
 
 bool SSTable::bloom_test(uint64_t key) {
-    uint32_t cur_hash[4] = {0};
-    MurmurHash3_x64_128(&key, sizeof(key), 1, cur_hash);
-
-    return (bloom_filter.test(cur_hash[0] % FILTER_BIT_SIZE) &&
-            bloom_filter.test(cur_hash[1] % FILTER_BIT_SIZE) &&
-            bloom_filter.test(cur_hash[2] % FILTER_BIT_SIZE) &&
-            bloom_filter.test(cur_hash[3] % FILTER_BIT_SIZE));
+    if (!is_partitioned()) return filter_test(filter.data(), filter.size(), key);
+
+    // cached after the index partitions
+    std::shared_ptr<const void> owner;
+    Slice bytes = load_metadata(partition_index.size(), filter_offset, filter_size, owner);
+    // a filter that can't be read rules nothing out
+    if (bytes.size != filter_size) return true;
+    return filter_test(bytes.data, bytes.size, key);
 }
 
-size_t SSTable::binary_search(uint64_t key) {
-    size_t left = 0, right = table_header.kv_count - 1;
-    while (left <= right) {
-        size_t mid = (left + right) >> 1;
-        uint64_t mid_key = data_index[mid].key;
-        if (mid_key == key) return mid;
-        if (mid_key > key) right = mid - 1;
-        else left = mid + 1;
+bool SSTable::range_test(uint64_t start, uint64_t end) {
+    start = std::max(start, table_header.min_key);
+    end = std::min(end, table_header.max_key);
+    if (start > end) return false;
+    if (!(table_header.flags & RANGE_FILTER)) return true;
+    uint64_t first = start >> range_shift, last = end >> range_shift;
+    if (last - first >= RANGE_FILTER_PROBES) return true;
+
+    Slice bytes(range_filter);
+    std::shared_ptr<const void> owner;
+    if (is_partitioned()) {
+        // cached after the index partitions & the filter
+        bytes = load_metadata(partition_index.size() + 1, range_offset, range_size, owner);
+        if (bytes.size != range_size) return true;
+    }
+    for (uint64_t prefix = first; ; ++prefix) {
+        if (bloom::may_contain(bytes.data, bytes.size, prefix)) return true;
+        if (prefix == last) return false;
     }
-    return table_header.kv_count;
 }
 
-SSTable::SSTable(std::vector<value_type> *data, uint64_t ts, const std::string &dir) {
+namespace {
+    /* ----- Walk sorted pairs like SkipList::Iterator, for SSTable::build ----- */
+    struct BufferCursor {
+        const MergeBuffer *buffer;
+        size_t index;
+        explicit BufferCursor(const MergeBuffer &data): buffer(&data), index(0) {}
+        bool valid() const { return index < buffer->get_size(); }
+        void next() { ++index; }
+        uint64_t key() const { return buffer->key(index); }
+        Slice value() const { return buffer->value(index); }
+    };
+
+    struct VectorCursor {
+        std::vector<value_type>::const_iterator cur, end;
+        explicit VectorCursor(const std::vector<value_type> &data): cur(data.begin()), end(data.end()) {}
+        bool valid() const { return cur != end; }
+        void next() { ++cur; }
+        uint64_t key() const { return cur->first; }
+        Slice value() const { return Slice(cur->second); }
+    };
+}
 
-    uint64_t kc = data->size();
-    uint64_t min = data->begin()->first;
-    uint64_t max = (data->end() - 1)->first;
-    table_header = Header(ts, kc, min, max);
+SSTable::SSTable(std::vector<value_type> *data, uint64_t ts, const std::string &dir, const TableOptions &options,
+                 std::shared_ptr<TableCache> cache):
+    obsolete(false), durable(true), cache_id(next_cache_id++),
+    table_cache(cache ? std::move(cache) : TableCache::standalone()), mapped_file(nullptr), mapped_size(0),
+    filter_offset(0), filter_size(0),
+    range_shift(0), range_offset(0), range_size(0), block_count(0) {
+    build(VectorCursor(*data), data->size(), ts, dir, options);
+    delete data;
+}
 
-    file_path = dir + "/" + my_itoa(SSTable::table_id++) + ".sst";
+SSTable::SSTable(const MergeBuffer &buffer, uint64_t ts, const std::string &dir, const TableOptions &options,
+                 std::shared_ptr<TableCache> cache):
+    obsolete(false), durable(true), cache_id(next_cache_id++),
+    table_cache(cache ? std::move(cache) : TableCache::standalone()), mapped_file(nullptr), mapped_size(0),
+    filter_offset(0), filter_size(0),
+    range_shift(0), range_offset(0), range_size(0), block_count(0) {
+    build(BufferCursor(buffer), buffer.get_size(), ts, dir, options);
+}
 
-    header_offset = cal_size(kc, 0);
+SSTable::SSTable(const SkipList &mem_table, uint64_t ts, const std::string &dir, const TableOptions &options,
+                 std::shared_ptr<TableCache> cache):
+    obsolete(false), durable(true), cache_id(next_cache_id++),
+    table_cache(cache ? std::move(cache) : TableCache::standalone()), mapped_file(nullptr), mapped_size(0),
+    filter_offset(0), filter_size(0),
+    range_shift(0), range_offset(0), range_size(0), block_count(0) {
+    build(SkipList::Iterator(mem_table), mem_table.get_kv_count(), ts, dir, options);
+}
+
+template<typename Cursor>
+void SSTable::build(Cursor data, uint64_t kv_count, uint64_t ts, const std::string &dir, const TableOptions &options) {
+    bool legacy = options.format_version == LEGACY_FORMAT;
+    // an xor filter is built from all keys at once, after the pass
+    bool use_xor = !legacy && options.xor_filter && options.filter_bits_per_key;
 
     // Generate the remaining data members at the same time
-    data_index = new IndexData[kc];
-    auto cur_data = data->begin();
+    if (legacy) filter.assign(FILTER_BYTE_SIZE, '\0');
+    else if (!use_xor) filter.assign(bloom::filter_size(kv_count, options.filter_bits_per_key), '\0');
+    bool use_range = !legacy && options.range_filter_bits_per_prefix;
+    range_shift = std::min(options.range_filter_shift, (size_t)63);
+    std::vector<uint64_t> keys, prefixes;
+    if (legacy || use_xor) keys.reserve(kv_count);
+    if (legacy) value_offsets.reserve(kv_count);
+    Cursor cur_data = data;
     size_t index = 0;
     uint32_t offset = 0;
-    while (cur_data != data->end()) {
-        uint64_t cur_key = cur_data->first;
+    uint64_t max = 0;
+    while (cur_data.valid() && index < kv_count) {
+        uint64_t cur_key = cur_data.key();
 
         // Generate data index
-        data_index[index] = IndexData(cur_key, offset);
-        offset += cur_data->second.size();
+        if (legacy || use_xor) keys.push_back(cur_key);
+        if (legacy) value_offsets.push_back(offset);
+        index++;
+        offset += cur_data.value().size;
+        max = cur_key;
 
         // Configure bloom filter
-        uint32_t hash[4] = {0};
-        MurmurHash3_x64_128(&cur_key, sizeof(cur_key), 1, hash);
-        bloom_filter.set(hash[0] % FILTER_BIT_SIZE);
-        bloom_filter.set(hash[1] % FILTER_BIT_SIZE);
-        bloom_filter.set(hash[2] % FILTER_BIT_SIZE);
-        bloom_filter.set(hash[3] % FILTER_BIT_SIZE); // Expanding the loop to improve efficiency
+        if (legacy) legacy_filter_add(&filter[0], cur_key);
+        else if (!use_xor) bloom::add(&filter[0], filter.size(), cur_key);
+        // keys are sorted, so equal prefixes are adjacent
+        uint64_t prefix = cur_key >> range_shift;
+        if (use_range && (prefixes.empty() || prefixes.back() != prefix)) prefixes.push_back(prefix);
 
-        cur_data++;
+        cur_data.next();
     }
     string_length = offset;
+    value_bytes = offset;
+    if (use_xor && !xor_filter::build(keys, filter)) {
+        // no seed gave a peelable layout (very unlikely), keep a bloom filter instead
+        use_xor = false;
+        filter.assign(bloom::filter_size(kv_count, options.filter_bits_per_key), '\0');
+        for (uint64_t key : keys) bloom::add(&filter[0], filter.size(), key);
+    }
+    if (legacy) index_keys = KeyIndex(std::move(keys));
+    if (use_range) {
+        range_filter.assign(bloom::filter_size(prefixes.size(), options.range_filter_bits_per_prefix), '\0');
+        for (uint64_t prefix : prefixes) bloom::add(&range_filter[0], range_filter.size(), prefix);
+    }
+
+    uint64_t min = data.key();
+    uint32_t flags = 0;
+    if (!legacy) {
+        flags = (use_xor ? XOR_FILTER : BLOCKED_FILTER) | (options.partition_index ? PARTITIONED_INDEX : 0) |
+                (use_range ? RANGE_FILTER : 0) | VALUE_BYTES;
+    }
+    table_header = Header(ts, kv_count, min, max, legacy ? LEGACY_FORMAT : BLOCK_FORMAT, flags);
+
+    file_path = dir + "/" + my_itoa(SSTable::table_id++) + ".sst";
 
-    // write front header to file
-    std::ofstream ssTable_in_file(file_path, std::ios_base::trunc | std::ios_base::binary);
+    // written under a temporary name, so a crash never leaves a truncated table behind
+    std::string tmp_path = file_path + ".tmp";
+    // write front header to file, the whole table goes out in a few large writes
+    std::vector<char> write_buffer(256 << 10);
+    std::ofstream ssTable_in_file;
+    ssTable_in_file.rdbuf()->pubsetbuf(write_buffer.data(), (std::streamsize)write_buffer.size());
+    ssTable_in_file.open(tmp_path, std::ios_base::trunc | std::ios_base::binary);
     write_header(ssTable_in_file);
 
-    // write string data to file
-    cur_data = data->begin();
-    while (cur_data != data->end()) {
-        ssTable_in_file.write(cur_data->second.c_str(), cur_data->second.size());
-        cur_data++;
+    if (legacy) {
+        header_offset = cal_size(kv_count, 0);
+        index_offset = header_offset + string_length;
+        // write string data to file
+        cur_data = data;
+        for (index = 0; index < kv_count; ++index) {
+            Slice value = cur_data.value();
+            ssTable_in_file.write(value.data, (long long)value.size);
+            cur_data.next();
+        }
+    } else {
+        write_blocks(data, ssTable_in_file, options);
     }
 
     ssTable_in_file.close();
-    delete data;
+    // the table must survive a crash before the logs holding its data are removed
+    durable = !ssTable_in_file.fail() && utils::syncPath(tmp_path.c_str(), false) == 0 &&
+              std::rename(tmp_path.c_str(), file_path.c_str()) == 0 && utils::syncPath(dir.c_str(), true) == 0;
+    if (!durable) perror("SSTable::build");
+
+    // the filter is on disk now, read it from there like a reopened table
+    if (is_partitioned()) {
+        std::string().swap(filter);
+        std::string().swap(range_filter);
+    }
 }
 
-SSTable::SSTable(ListNode *data_head, uint64_t kv_count, uint64_t ts, const std::string &dir) {
-
-    // Generate the remaining data members at the same time
-    data_index = new IndexData[kv_count + 1];
-    ListNode *cur_node = data_head;
-    size_t index = 0;
-    uint32_t offset = 0;
-    while (cur_node->next) {
-        cur_node = cur_node->next;
-        uint64_t cur_key = cur_node->key;
-
-        // Generate data index
-        data_index[index++] = IndexData(cur_key, offset);
-        offset += cur_node->value.size();
-
-        // Configure bloom filter
-        uint32_t hash[4] = {0};
-        MurmurHash3_x64_128(&cur_key, sizeof(cur_key), 1, hash);
-        bloom_filter.set(hash[0] % FILTER_BIT_SIZE);
-        bloom_filter.set(hash[1] % FILTER_BIT_SIZE);
-        bloom_filter.set(hash[2] % FILTER_BIT_SIZE);
-        bloom_filter.set(hash[3] % FILTER_BIT_SIZE); // Expanding the loop to improve efficiency
+template<typename Cursor>
+void SSTable::write_blocks(Cursor data, std::ofstream &out, const TableOptions &options) {
+    header_offset = (uint64_t)out.tellp();
+    string_length = 0;
+
+    std::string contents;
+    std::vector<uint32_t> entry_offsets;
+    Cursor cur_data = data;
+    for (uint64_t index = 0; index < table_header.kv_count; ++index) {
+        uint64_t cur_key = cur_data.key();
+        Slice value = cur_data.value();
+        auto length = (uint32_t)value.size;
+        entry_offsets.push_back((uint32_t)contents.size());
+        contents.append((const char*)&cur_key, 8);
+        contents.append((const char*)&length, 4);
+        contents.append(value.data, value.size);
+        cur_data.next();
+
+        if (contents.size() >= options.block_size || index + 1 == table_header.kv_count) {
+            for (uint32_t entry_offset : entry_offsets) {
+                contents.append((const char*)&entry_offset, 4);
+            }
+            auto count = (uint32_t)entry_offsets.size();
+            contents.append((const char*)&count, 4);
+            write_block(out, contents, cur_key, count, options);
+            contents.clear();
+            entry_offsets.clear();
+        }
     }
-    string_length = offset;
 
-    uint64_t min = data_head->next->key;
-    uint64_t max = cur_node->key;
-    table_header = Header(ts, kv_count, min, max);
-    header_offset = cal_size(kv_count, 0);
+    block_count = block_index.size();
+    index_offset = header_offset + string_length;
+    auto write_handle = [&out](const BlockHandle &handle) {
+        out.write((const char*)&handle.last_key, 8);
+        out.write((const char*)&handle.offset, 8);
+        out.write((const char*)&handle.size, 4);
+        out.write((const char*)&handle.count, 4);
+    };
+
+    uint64_t entry_count = block_count;
+    if (is_partitioned()) {
+        // index partitions, then the index of partitions
+        size_t entry_size = INDEX_ENTRY_SIZE;
+        size_t per_partition = std::max(options.index_partition_size / entry_size, (size_t)1);
+        for (size_t first = 0; first < block_count; first += per_partition) {
+            size_t last = std::min(first + per_partition, (size_t)block_count);
+            PartitionHandle partition{block_index[last - 1].last_key, index_offset,
+                                      (uint32_t)((last - first) * entry_size), (uint32_t)(last - first),
+                                      0, first, block_index[first].first_index};
+            for (size_t block = first; block < last; ++block) {
+                write_handle(block_index[block]);
+                partition.pair_count += block_index[block].count;
+            }
+            index_offset += partition.size;
+            partition_index.push_back(partition);
+        }
+        for (auto &partition : partition_index) {
+            out.write((const char*)&partition.last_key, 8);
+            out.write((const char*)&partition.offset, 8);
+            out.write((const char*)&partition.size, 4);
+            out.write((const char*)&partition.block_count, 4);
+            out.write((const char*)&partition.pair_count, 8);
+        }
+        entry_count = partition_index.size();
+        std::vector<BlockHandle>().swap(block_index);
+    } else {
+        for (auto &handle : block_index) write_handle(handle);
+    }
 
-    file_path = dir + "/" + my_itoa(SSTable::table_id++) + ".sst";
+    index_last_keys();
 
-    // write front header to file
-    std::ofstream ssTable_in_file(file_path, std::ios_base::trunc | std::ios_base::binary);
-    write_header(ssTable_in_file);
+    // footer
+    uint64_t magic = TABLE_MAGIC;
+    out.write((const char*)&index_offset, 8);
+    out.write((const char*)&entry_count, 8);
+    out.write((const char*)&magic, 8);
+}
 
-    // write string data to file
-    cur_node = data_head->next;
-    while (cur_node) {
-        auto value_size = (long long)(cur_node->value.size());
-        auto value_str = cur_node->value.c_str();
-        //if (value_size == 2) printf("1: %s to %s\n", value_str, file_path.c_str());
-        ssTable_in_file.write(value_str, value_size);
-        cur_node = cur_node->next;
+void SSTable::write_block(std::ofstream &out, std::string &contents, uint64_t last_key,
+                          uint32_t count, const TableOptions &options) {
+    auto type = Compression::NONE;
+    if (options.compression == Compression::LZ) {
+        std::string compressed;
+        auto raw_size = (uint32_t)contents.size();
+        compressed.append((const char*)&raw_size, 4);
+        compression::lz_compress(contents.data(), contents.size(), compressed);
+        // keep the compressed form only if it saves 1/8 of the block
+        if (compressed.size() < contents.size() - contents.size() / 8) {
+            contents.swap(compressed);
+            type = Compression::LZ;
+        }
     }
-
-    ssTable_in_file.close();
+    contents.push_back((char)type);
+    uint32_t crc = crc32(contents.data(), contents.size());
+    contents.append((const char*)&crc, 4);
+    out.write(contents.data(), (long long)contents.size());
+
+    uint64_t first_index = block_index.empty() ? 0 : block_index.back().first_index + block_index.back().count;
+    block_index.push_back(BlockHandle{last_key, header_offset + string_length,
+                                      (uint32_t)contents.size(), count, first_index});
+    string_length += contents.size();
 }
 
-SSTable::SSTable(const std::string &_file_path) {
+SSTable::SSTable(const std::string &_file_path, std::shared_ptr<TableCache> cache):
+    obsolete(false), durable(true), cache_id(next_cache_id++),
+    table_cache(cache ? std::move(cache) : TableCache::standalone()), mapped_file(nullptr), mapped_size(0),
+    filter_offset(0), filter_size(0),
+    range_shift(0), range_offset(0), range_size(0), block_count(0) {
     file_path = _file_path;
     std::ifstream cur_SSTable(file_path, std::ios_base::in | std::ios_base::binary);
 
-    cur_SSTable.read((char*)(&table_header), sizeof(Header));
+    uint64_t magic = 0;
+    cur_SSTable.read((char*)(&magic), 8);
+    uint32_t version = LEGACY_FORMAT, flags = 0;
+    if (magic == TABLE_MAGIC) {
+        cur_SSTable.read((char*)(&version), 4);
+        cur_SSTable.read((char*)(&flags), 4);
+    } else {
+        cur_SSTable.seekg(0);
+    }
+    cur_SSTable.read((char*)(&table_header), LEGACY_HEADER_SIZE);
+    table_header.version = version;
+    table_header.flags = flags;
     uint64_t KV_COUNT = table_header.kv_count;
 
-    char *buf = new char[FILTER_BYTE_SIZE];
-    cur_SSTable.read(buf, FILTER_BYTE_SIZE);
-    bitset_from_bytes(buf);
-    delete[] buf;
-
-    data_index = new IndexData[KV_COUNT + 1];
-    for (size_t ind = 0; ind < KV_COUNT; ++ind) {
-        cur_SSTable.read((char*)(&(data_index[ind].key)), 8);
-        cur_SSTable.read((char*)(&(data_index[ind].offset)), 4);
+    filter_size = FILTER_BYTE_SIZE;
+    if (flags & SIZED_FILTER) cur_SSTable.read((char*)(&filter_size), 8);
+    filter_offset = cur_SSTable.tellg();
+    if (is_partitioned()) {
+        // read on demand
+        cur_SSTable.seekg((long long)filter_size, std::ifstream::cur);
+    } else {
+        filter.resize(filter_size);
+        cur_SSTable.read(&filter[0], (long long)filter_size);
+        if (!(flags & SIZED_FILTER) && legacy_filter_broken(filter)) filter.clear();
+    }
+    if (flags & RANGE_FILTER) {
+        cur_SSTable.read((char*)(&range_shift), 8);
+        cur_SSTable.read((char*)(&range_size), 8);
+        range_offset = cur_SSTable.tellg();
+        if (is_partitioned()) {
+            cur_SSTable.seekg((long long)range_size, std::ifstream::cur);
+        } else {
+            range_filter.resize(range_size);
+            cur_SSTable.read(&range_filter[0], (long long)range_size);
+        }
+    }
+    value_bytes = 0;
+    if (flags & VALUE_BYTES) cur_SSTable.read((char*)(&value_bytes), 8);
+
+    if (table_header.version == LEGACY_FORMAT) {
+        std::vector<uint64_t> keys(KV_COUNT);
+        value_offsets.resize(KV_COUNT);
+        for (size_t ind = 0; ind < KV_COUNT; ++ind) {
+            cur_SSTable.read((char*)(&keys[ind]), 8);
+            cur_SSTable.read((char*)(&value_offsets[ind]), 4);
+        }
+        index_keys = KeyIndex(std::move(keys));
+
+        header_offset = cur_SSTable.tellg();
+        cur_SSTable.seekg(0, std::ifstream::end);
+        string_length = (size_t)cur_SSTable.tellg() - header_offset;
+        index_offset = header_offset + string_length;
+    } else {
+        header_offset = cur_SSTable.tellg();
+        uint64_t entry_count = 0;
+        cur_SSTable.seekg(-(long long)FOOTER_SIZE, std::ifstream::end);
+        cur_SSTable.read((char*)(&index_offset), 8);
+        cur_SSTable.read((char*)(&entry_count), 8);
+
+        cur_SSTable.seekg(index_offset);
+        uint64_t first_index = 0;
+        if (is_partitioned()) {
+            partition_index.resize(entry_count);
+            for (auto &partition : partition_index) {
+                cur_SSTable.read((char*)(&partition.last_key), 8);
+                cur_SSTable.read((char*)(&partition.offset), 8);
+                cur_SSTable.read((char*)(&partition.size), 4);
+                cur_SSTable.read((char*)(&partition.block_count), 4);
+                cur_SSTable.read((char*)(&partition.pair_count), 8);
+                partition.first_block = block_count;
+                partition.first_index = first_index;
+                block_count += partition.block_count;
+                first_index += partition.pair_count;
+            }
+            // data blocks end where the first partition begins
+            string_length = (entry_count ? partition_index[0].offset : index_offset) - header_offset;
+        } else {
+            block_index.resize(entry_count);
+            for (auto &handle : block_index) {
+                cur_SSTable.read((char*)(&handle.last_key), 8);
+                cur_SSTable.read((char*)(&handle.offset), 8);
+                cur_SSTable.read((char*)(&handle.size), 4);
+                cur_SSTable.read((char*)(&handle.count), 4);
+                handle.first_index = first_index;
+                first_index += handle.count;
+            }
+            block_count = entry_count;
+            string_length = index_offset - header_offset;
+        }
+        index_last_keys();
     }
-    
-    header_offset = cur_SSTable.tellg();
-    cur_SSTable.seekg(0, std::ifstream::end);
-    string_length = (size_t)cur_SSTable.tellg() - header_offset;
+    // legacy values are stored as is, blocks of earlier builds are counted as stored
+    if (!(flags & VALUE_BYTES)) value_bytes = string_length;
 
     cur_SSTable.close();
 }
 
 SSTable::~SSTable() {
-    delete[] data_index;
+    if (mapped_file) utils::unmapFile(mapped_file, mapped_size);
+    table_cache->files.erase(cache_id);
+    if (obsolete) delete_file();
+    if (obsolete && delete_before) {
+        utils::syncPath(file_path.substr(0, file_path.find_last_of('/')).c_str(), true);
+    }
+    // delete_before is released from here on
 }
 
 void SSTable::write_header(std::ofstream &ssTable_in_file) {
     uint64_t KV_COUNT = table_header.kv_count;
-    ssTable_in_file.write((char*)(&table_header), sizeof(Header));
+    bool legacy = table_header.version == LEGACY_FORMAT;
+    if (!legacy) {
+        uint64_t magic = TABLE_MAGIC;
+        ssTable_in_file.write((char*)(&magic), 8);
+        ssTable_in_file.write((char*)(&table_header.version), 4);
+        ssTable_in_file.write((char*)(&table_header.flags), 4);
+    }
+    ssTable_in_file.write((char*)(&table_header), LEGACY_HEADER_SIZE);
+
+    filter_size = filter.size();
+    if (table_header.flags & SIZED_FILTER) ssTable_in_file.write((char*)(&filter_size), 8);
+    filter_offset = ssTable_in_file.tellp();
+    ssTable_in_file.write(filter.data(), (long long)filter_size);
+
+    if (table_header.flags & RANGE_FILTER) {
+        range_size = range_filter.size();
+        ssTable_in_file.write((char*)(&range_shift), 8);
+        ssTable_in_file.write((char*)(&range_size), 8);
+        range_offset = ssTable_in_file.tellp();
+        ssTable_in_file.write(range_filter.data(), (long long)range_size);
+    }
+    if (table_header.flags & VALUE_BYTES) ssTable_in_file.write((char*)(&value_bytes), 8);
 
-    char *bit_seq = new char[FILTER_BYTE_SIZE];
-    bitset_to_bytes(bit_seq);
-    ssTable_in_file.write(bit_seq, FILTER_BYTE_SIZE);
-    delete[] bit_seq;
-    
+    if (!legacy) return;
     for (size_t ind = 0; ind < KV_COUNT; ++ind) {
-        ssTable_in_file.write((char*)(&(data_index[ind].key)), 8);
-        ssTable_in_file.write((char*)(&(data_index[ind].offset)), 4);
-
+        uint64_t key = index_keys[ind];
+        ssTable_in_file.write((char*)(&key), 8);
+        ssTable_in_file.write((char*)(&value_offsets[ind]), 4);
     }
 }
 
@@ -199,156 +499,563 @@ std::string SSTable::get_by_index(uint64_t index) {
 
     size_t KV_COUNT = table_header.kv_count;
 
-    if (index >= KV_COUNT) 
+    if (index >= KV_COUNT)
         return "";
 
-    size_t cur_offset = data_index[index].offset;
-    std::ifstream ssTable_in_file(file_path);
-    ssTable_in_file.seekg(header_offset + cur_offset);
-    size_t cur_length = (index != KV_COUNT - 1) ? 
-            data_index[index + 1].offset - cur_offset : 
-            string_length - cur_offset;
+    if (table_header.version != LEGACY_FORMAT) {
+        BlockHandle handle;
+        size_t block = block_of(index, handle);
+        Block cur_block;
+        if (block == BROKEN_INDEX || load_block(block, handle, nullptr, cur_block) != Status::OK) return "";
+        uint64_t pos = index - handle.first_index;
+        return pos < cur_block.count ? cur_block.value((uint32_t)pos).to_string() : "";
+    }
+
+    size_t cur_offset = value_offsets[index];
+    size_t cur_length = value_length(index);
 
-    char *str_buf = new char[cur_length];
-    ssTable_in_file.read(str_buf, cur_length);
-    std::string cur_data(str_buf, cur_length);
-    delete[] str_buf;
+    if (const char *mapped = mapping()) {
+        return std::string(mapped + header_offset + cur_offset, cur_length);
+    }
+    std::string cur_data(cur_length, '\0');
+    if (!read_at(header_offset + cur_offset, &cur_data[0], cur_length)) return "";
 
     return cur_data;
 }
 
-scope_type SSTable::get_scope() {
-    return std::make_pair(table_header.min_key, table_header.max_key);
+const char *SSTable::mapping() {
+    if (!table_cache->mmap_reads) return nullptr;
+    std::call_once(map_once, [this] {
+        FileCache::file_ptr file = table_cache->files.open(cache_id, file_path);
+        if (!file) return;
+        size_t size = index_offset;
+        mapped_file = utils::mapFile(file->fd, size);
+        if (mapped_file) {
+            mapped_size = size;
+            utils::adviseFile(mapped_file, mapped_size, false);
+        }
+    });
+    return mapped_file;
 }
 
-std::ifstream *SSTable::open_file() {
-    auto *target = new std::ifstream(file_path, std::ios_base::in | std::ios_base::binary);
-    target->seekg(header_offset);
-    return target;
+bool SSTable::read_at(uint64_t offset, char *buf, size_t n) {
+    FileCache::file_ptr file = table_cache->files.open(cache_id, file_path);
+    if (!file) {
+        perror("SSTable::read_at");
+        return false;
+    }
+    while (n) {
+        long long got = utils::readFileAt(file->fd, buf, n, offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            perror("SSTable::read_at");
+            return false;
+        }
+        if (got == 0) {
+            // errno is left as it was, the file is just shorter than its index says
+            fprintf(stderr, "SSTable::read_at: %s ends at offset %llu, %zu more bytes expected\n",
+                    file_path.c_str(), (unsigned long long)offset, n);
+            return false;
+        }
+        buf += got;
+        offset += got;
+        n -= got;
+    }
+    return true;
 }
 
-std::string SSTable::read_by_index(std::ifstream &fs, uint64_t index) {
-    size_t cur_offset = data_index[index].offset;
-    size_t cur_length = (index != table_header.kv_count - 1) ? 
-            data_index[index + 1].offset - cur_offset : 
-            string_length - cur_offset;
+scope_type SSTable::get_scope() {
+    return std::make_pair(table_header.min_key, table_header.max_key);
+}
 
-    char *str_buf = new char[cur_length];
-    fs.read(str_buf, cur_length);
-    std::string cur_data(str_buf, cur_length);
-    delete[] str_buf;
+uint64_t SSTable::get_data_size() const {
+    return string_length;
+}
 
-    return cur_data;
+uint64_t SSTable::get_raw_size() const {
+    return cal_size(table_header.kv_count, value_bytes);
 }
 
 uint64_t SSTable::get_time_stamp() const {
     return table_header.time_stamp;
 }
 
-std::vector<SSTable*> merge_table(std::vector<SSTable*> &prepared_data, bool is_delete, const std::string &dir) {
+uint32_t SSTable::get_format_version() const {
+    return table_header.version;
+}
+
+Status merge_table(const std::vector<std::shared_ptr<SSTable>> &prepared_data,
+                   bool is_delete, const std::string &dir, const TableOptions &options,
+                   uint64_t time_stamp, size_t readahead, uint64_t start, uint64_t end,
+                   const std::shared_ptr<TableCache> &cache, std::vector<SSTable*> &merged_data) {
 
-    std::priority_queue<MergeInfo> merge_heap;
-    std::vector<SSTable*> merged_data;
+    merged_data.clear();
     MergeBuffer buffer;
-    uint64_t max_ts = 0;
-
-    std::ifstream *fs_store[prepared_data.size()];
-    
-    // initialize min keys
-    uint64_t table_index = 0;
-    for (auto cur_table_itr : prepared_data) {
-        uint64_t mk = cur_table_itr->data_index[0].key;
-        uint64_t ts = cur_table_itr->table_header.time_stamp;
-        std::ifstream *fs = cur_table_itr->open_file();
-        fs_store[table_index] = fs;
-        merge_heap.push(MergeInfo(mk, ts, 0, table_index++, fs));
-
-        if (ts > max_ts) max_ts = ts;
-    }
-
-    while (!merge_heap.empty()) {
-        MergeInfo cur_data = merge_heap.top();
-        merge_heap.pop();
-        
-        uint64_t cur_data_key = cur_data.min_key;
-        SSTable *cur_table = prepared_data[cur_data.table_index];
-        std::string cur_data_string = cur_table->read_by_index((*cur_data.file_stream), cur_data.index);
-
-
-
-        if (cur_data_key != buffer.get_rear()->key || !buffer.get_size()) { 
-            // not the same key, just append
-            if (!is_delete || cur_data_string != "~DELETED~") {
-                // no need / not a delete flag, try to append data
-                if (!buffer.push_back(cur_data_key, cur_data_string)) {
-                    // space not enough -> save to SSTable (time stamps equal to max_ts)
-                    auto *new_table = new SSTable(buffer.get_head(), buffer.get_size(), max_ts, dir);
-                    merged_data.push_back(new_table);
-                    buffer.clear();
-                    // don't forget to push it again
-                    buffer.push_back(cur_data_key, cur_data_string);
-                }
-            } else {
-                // delete tag: pop all element with the same key
-                while (!merge_heap.empty() && merge_heap.top().min_key == cur_data_key) {
-                    MergeInfo deleted_data = merge_heap.top();
-                    merge_heap.pop();
-                    //set file flag
-                    SSTable *cur_tb = prepared_data[deleted_data.table_index];
-                    std::string useless_string = cur_tb->read_by_index((*deleted_data.file_stream), deleted_data.index);
-
-                    if (++(deleted_data.index) < cur_table->table_header.kv_count) {
-                        // if not the end, set index to next element of current table, and push it back to heap
-                        deleted_data.min_key = cur_tb->data_index[deleted_data.index].key;
-                        merge_heap.push(deleted_data);
-                    }
-                }
-            }
+
+    // tables of either format are read through their iterators, front to back
+    std::vector<std::unique_ptr<Iterator>> inputs;
+    for (auto &cur_table : prepared_data) {
+        if (cur_table->table_header.max_key < start || cur_table->table_header.min_key > end) continue;
+
+        // mapped tables are read front to back from here on, no more point reads expected
+        if (const char *mapped = cur_table->mapping()) {
+            utils::adviseFile(mapped, cur_table->mapped_size, true);
         }
+        std::unique_ptr<SSTable::Iterator> itr(new SSTable::Iterator(cur_table));
+        itr->set_readahead(readahead);
+        inputs.push_back(std::move(itr));
+    }
 
-        // set min key to next element's key, and push it back to heap
-        if (++(cur_data.index) < cur_table->table_header.kv_count) {
-            // if not the end, set index to next element of current table, and push it back to heap
-            cur_data.min_key = cur_table->data_index[cur_data.index].key;
-            merge_heap.push(cur_data);
+    // newest version of each key only, deleted keys dropped if asked
+    MergingIterator merged(std::move(inputs), is_delete, start, end);
+    for (merged.seek_to_first(); merged.valid(); merged.next()) {
+        Slice cur_value = merged.value();
+        if (!buffer.push_back(merged.key(), cur_value)) {
+            // space not enough -> save to SSTable, the buffer isn't empty as it refused a pair
+            merged_data.push_back(new SSTable(buffer, time_stamp, dir, options, cache));
+            buffer.clear();
+            // don't forget to push it again, an empty buffer takes it
+            buffer.push_back(merged.key(), cur_value);
         }
     }
 
+    // an input cut short by a broken block would lose the rest of its pairs
+    Status status = merged.status();
+
     // push remaining data to SSTable, and write them to Disk when constructing
-    if (buffer.get_size() != 0) {
-        auto *new_table = new SSTable(buffer.get_head(), buffer.get_size(), max_ts, dir);
-        merged_data.push_back(new_table);
+    if (status == Status::OK && buffer.get_size() != 0) {
+        merged_data.push_back(new SSTable(buffer, time_stamp, dir, options, cache));
+    }
+    for (auto cur_table : merged_data) {
+        if (status == Status::OK && !cur_table->is_durable()) status = Status::IO_ERROR;
+    }
+
+    if (status != Status::OK) {
+        for (auto cur_table : merged_data) {
+            cur_table->mark_obsolete();
+            delete cur_table;
+        }
+        merged_data.clear();
+    }
+    return status;
+}
+
+size_t SSTable::value_length(uint64_t index) const {
+    return (index != table_header.kv_count - 1) ?
+            value_offsets[index + 1] - value_offsets[index] :
+            string_length - value_offsets[index];
+}
+
+BlockCache::block_ptr SSTable::read_window(uint64_t window, BlockCache &cache) {
+    BlockCache::block_ptr cached = cache.lookup(cache_id, window);
+    if (!cached) {
+        size_t window_start = window * BlockCache::BLOCK_SIZE;
+        size_t window_length = std::min((size_t)BlockCache::BLOCK_SIZE, string_length - window_start);
+        std::string window_data(window_length, '\0');
+        // a failed read is not cached, later gets try the file again
+        if (!read_at(header_offset + window_start, &window_data[0], window_length)) return nullptr;
+        cached = cache.insert(cache_id, window, std::move(window_data));
+    }
+    return cached;
+}
+
+Status SSTable::read_cached(size_t offset, size_t length, PinnedValue &value, BlockCache &cache) {
+    if (length == 0) {
+        value.own(0);
+        return Status::OK;
+    }
+    uint64_t window = offset / BlockCache::BLOCK_SIZE;
+    size_t window_offset = offset % BlockCache::BLOCK_SIZE;
+    BlockCache::block_ptr cached = read_window(window, cache);
+    if (!cached) return Status::CORRUPTION;
+    if (window_offset + length <= cached->size()) {
+        value.pin(Slice(cached->data() + window_offset, length), cached);
+        return Status::OK;
+    }
+    char *buf = value.own(length);
+    size_t copied = 0;
+    while (true) {
+        size_t take = std::min(cached->size() - window_offset, length - copied);
+        memcpy(buf + copied, cached->data() + window_offset, take);
+        copied += take;
+        if (copied == length) break;
+        cached = read_window(++window, cache);
+        if (!cached) return Status::CORRUPTION;
+        window_offset = 0;
+    }
+    return Status::OK;
+}
+
+SSTable::Block::Block(): count(0) {}
+
+SSTable::Block::Block(Slice d, std::shared_ptr<const void> o): data(d), owner(std::move(o)), count(0) {
+    if (data.size < 4) return;
+    uint32_t n;
+    memcpy(&n, data.data + data.size - 4, 4);
+    if ((uint64_t)n * 4 + 4 <= data.size) count = n;
+}
+
+const char *SSTable::Block::entry(uint32_t i) const {
+    uint32_t offset;
+    memcpy(&offset, data.data + data.size - 4 - 4 * (size_t)(count - i), 4);
+    return data.data + offset;
+}
+
+uint64_t SSTable::Block::key(uint32_t i) const {
+    uint64_t key;
+    memcpy(&key, entry(i), 8);
+    return key;
+}
+
+Slice SSTable::Block::value(uint32_t i) const {
+    const char *cur_entry = entry(i);
+    uint32_t length;
+    memcpy(&length, cur_entry + 8, 4);
+    return Slice(cur_entry + 12, length);
+}
+
+uint32_t SSTable::Block::lower_bound(uint64_t key) const {
+    uint32_t left = 0, right = count;
+    while (left < right) {
+        uint32_t mid = left + (right - left) / 2;
+        if (this->key(mid) < key) left = mid + 1;
+        else right = mid;
+    }
+    return left;
+}
+
+void SSTable::index_last_keys() {
+    std::vector<uint64_t> keys;
+    if (is_partitioned()) {
+        for (auto &partition : partition_index) keys.push_back(partition.last_key);
+        partition_keys = KeyIndex(std::move(keys));
+    } else {
+        for (auto &handle : block_index) keys.push_back(handle.last_key);
+        block_keys = KeyIndex(std::move(keys));
+    }
+}
+
+bool SSTable::is_partitioned() const {
+    return table_header.flags & PARTITIONED_INDEX;
+}
+
+Slice SSTable::load_metadata(uint64_t piece, uint64_t offset, size_t size, std::shared_ptr<const void> &owner) {
+    if (const char *mapped = mapping()) {
+        owner = shared_from_this();
+        return Slice(mapped + offset, size);
+    }
+    BlockCache::block_ptr cached = table_cache->metadata.lookup(cache_id, piece);
+    if (!cached) {
+        std::string data(size, '\0');
+        if (!read_at(offset, &data[0], size)) return Slice();
+        cached = table_cache->metadata.insert(cache_id, piece, std::move(data));
+    }
+    owner = cached;
+    return Slice(*cached);
+}
+
+void SSTable::decode_handle(Slice partition, size_t i, uint64_t first_index, BlockHandle &handle) {
+    const char *entry = partition.data;
+    for (size_t before = 0; before < i; ++before, entry += INDEX_ENTRY_SIZE) {
+        uint32_t count;
+        memcpy(&count, entry + 20, 4);
+        first_index += count;
+    }
+    memcpy(&handle.last_key, entry, 8);
+    memcpy(&handle.offset, entry + 8, 8);
+    memcpy(&handle.size, entry + 16, 4);
+    memcpy(&handle.count, entry + 20, 4);
+    handle.first_index = first_index;
+}
+
+size_t SSTable::find_block(uint64_t key, BlockHandle &handle) {
+    if (!is_partitioned()) {
+        size_t found = block_keys.lower_bound(key);
+        if (found != block_count) handle = block_index[found];
+        return found;
+    }
+
+    size_t found = partition_keys.lower_bound(key);
+    if (found == partition_index.size()) return block_count;
+    auto part = partition_index.begin() + found;
+    std::shared_ptr<const void> owner;
+    Slice partition = load_metadata(part - partition_index.begin(), part->offset, part->size, owner);
+    if (partition.size != part->size) return BROKEN_INDEX;
+
+    // the last entry of the partition holds a key >= key
+    size_t left = 0, right = part->block_count - 1;
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        uint64_t last_key;
+        memcpy(&last_key, partition.data + mid * INDEX_ENTRY_SIZE, 8);
+        if (last_key < key) left = mid + 1;
+        else right = mid;
+    }
+    decode_handle(partition, left, part->first_index, handle);
+    return part->first_block + left;
+}
+
+size_t SSTable::block_of(uint64_t index, BlockHandle &handle) {
+    if (!is_partitioned()) {
+        auto found = std::upper_bound(block_index.begin(), block_index.end(), index,
+            [](uint64_t i, const BlockHandle &h) { return i < h.first_index; });
+        handle = *(found - 1);
+        return found - block_index.begin() - 1;
+    }
+
+    auto part = std::upper_bound(partition_index.begin(), partition_index.end(), index,
+        [](uint64_t i, const PartitionHandle &p) { return i < p.first_index; }) - 1;
+    std::shared_ptr<const void> owner;
+    Slice partition = load_metadata(part - partition_index.begin(), part->offset, part->size, owner);
+    if (partition.size != part->size) return BROKEN_INDEX;
+
+    size_t i = 0;
+    uint64_t first_index = part->first_index;
+    for (; i + 1 < part->block_count; ++i) {
+        uint32_t count;
+        memcpy(&count, partition.data + i * INDEX_ENTRY_SIZE + 20, 4);
+        if (index < first_index + count) break;
+        first_index += count;
+    }
+    decode_handle(partition, i, part->first_index, handle);
+    return part->first_block + i;
+}
+
+Status SSTable::load_block(size_t block, const BlockHandle &handle, BlockCache *cache, Block &found,
+                           const char *stored) {
+    size_t payload = handle.size - BLOCK_TRAILER_SIZE;
+    const char *mapped = mapping();
+    const char *raw = mapped ? mapped + handle.offset : stored;
+    bool pinnable = mapped && raw[payload] == (char)Compression::NONE;
+
+    if (cache && !pinnable) {
+        if (BlockCache::block_ptr cached = cache->lookup(cache_id, block)) {
+            found = Block(Slice(*cached), cached);
+            return Status::OK;
+        }
+    }
+    std::string raw_data;
+    if (!raw) {
+        raw_data.resize(handle.size);
+        if (!read_at(handle.offset, &raw_data[0], handle.size)) return Status::CORRUPTION;
+        raw = raw_data.data();
     }
 
-    // close all ifstream
-    for (auto fs : fs_store) {
-        fs->close();
-        delete fs;
+    uint32_t crc;
+    memcpy(&crc, raw + payload + 1, 4);
+    if (crc32(raw, payload + 1) != crc) {
+        fprintf(stderr, "SSTable: checksum mismatch in block %zu of %s\n", block, file_path.c_str());
+        return Status::CORRUPTION;
     }
 
-    // destruct merged tables, delete old SSTables
-    for (SSTable *merged_table : prepared_data) {
-        merged_table->delete_file();
-        delete merged_table;
+    std::string contents;
+    if (raw[payload] == (char)Compression::NONE) {
+        if (pinnable) {
+            found = Block(Slice(raw, payload), shared_from_this());
+            return Status::OK;
+        }
+        if (raw_data.empty()) {
+            contents.assign(raw, payload);
+        } else {
+            raw_data.resize(payload);
+            contents.swap(raw_data);
+        }
+    } else if (raw[payload] == (char)Compression::LZ && payload >= 4) {
+        uint32_t raw_size;
+        memcpy(&raw_size, raw, 4);
+        contents.resize(raw_size);
+        if (!compression::lz_decompress(raw + 4, payload - 4, &contents[0], raw_size)) {
+            fprintf(stderr, "SSTable: broken compressed block %zu of %s\n", block, file_path.c_str());
+            return Status::CORRUPTION;
+        }
+    } else {
+        fprintf(stderr, "SSTable: unknown compression of block %zu of %s\n", block, file_path.c_str());
+        return Status::CORRUPTION;
     }
 
-    return merged_data;
+    if (cache) {
+        BlockCache::block_ptr cached = cache->insert(cache_id, block, std::move(contents));
+        found = Block(Slice(*cached), cached);
+        return Status::OK;
+    }
+    auto owned = std::make_shared<const std::string>(std::move(contents));
+    found = Block(Slice(*owned), owned);
+    return Status::OK;
 }
 
-std::string SSTable::get(uint64_t key) {
-    if (bloom_test(key)) {
-        size_t ind = binary_search(key);
-        if (ind != table_header.kv_count) {
-            return get_by_index(ind); // may be "~DELETED~"
+Status SSTable::get(uint64_t key, PinnedValue &value, BlockCache *cache) {
+    if (!bloom_test(key)) return Status::NOT_FOUND;
+
+    if (table_header.version != LEGACY_FORMAT) {
+        BlockHandle handle;
+        size_t block = find_block(key, handle);
+        if (block == block_count) return Status::NOT_FOUND;
+        Block found;
+        if (block == BROKEN_INDEX || load_block(block, handle, cache, found) != Status::OK ||
+            found.count != handle.count) {
+            return Status::CORRUPTION;
+        }
+        uint32_t pos = found.lower_bound(key);
+        if (pos == found.count || found.key(pos) != key) return Status::NOT_FOUND;
+        // may be "~DELETED~"
+        value.pin(found.value(pos), std::move(found.owner));
+        return Status::OK;
+    }
+
+    size_t ind = index_keys.find(key);
+    if (ind == table_header.kv_count) return Status::NOT_FOUND;
+
+    // may be "~DELETED~"
+    size_t cur_offset = value_offsets[ind];
+    size_t cur_length = value_length(ind);
+    if (const char *mapped = mapping()) {
+        value.pin(Slice(mapped + header_offset + cur_offset, cur_length), shared_from_this());
+    } else if (cache) {
+        if (read_cached(cur_offset, cur_length, value, *cache) != Status::OK) {
+            value.reset();
+            return Status::CORRUPTION;
         }
+    } else if (!read_at(header_offset + cur_offset, value.own(cur_length), cur_length)) {
+        value.reset();
+        return Status::CORRUPTION;
     }
-    return "";
+    return Status::OK;
 }
 
 void SSTable::delete_file() {
     utils::rmfile(file_path.c_str());
 }
 
+void SSTable::mark_obsolete(const std::shared_ptr<SSTable> &newer) {
+    delete_before = newer;
+    obsolete = true;
+}
+
 std::string SSTable::get_table_path() {
     return file_path;
 }
+
+bool SSTable::is_durable() const {
+    return durable;
+}
+
+SSTable::Iterator::Iterator(std::shared_ptr<SSTable> t):
+    table(std::move(t)), index(table->table_header.kv_count), block_number(table->block_count),
+    readahead(0), window_offset(0), read_status(Status::OK) {}
+
+void SSTable::Iterator::set_readahead(size_t bytes) {
+    readahead = bytes;
+}
+
+const char *SSTable::Iterator::read_ahead(uint64_t offset, size_t size) {
+    if (!readahead || table->mapping()) return nullptr;
+    if (offset < window_offset || offset + size > window_offset + window.size()) {
+        uint64_t data_end = table->header_offset + table->string_length;
+        size_t length = std::max(size, (size_t)std::min((uint64_t)readahead, data_end - std::min(offset, data_end)));
+        window.resize(length);
+        window_offset = offset;
+        if (!table->read_at(offset, &window[0], length)) {
+            window.clear();
+            return nullptr;
+        }
+    }
+    return window.data() + (offset - window_offset);
+}
+
+bool SSTable::Iterator::load(size_t number, const BlockHandle &h) {
+    block_number = number;
+    handle = h;
+    const char *stored = read_ahead(handle.offset, handle.size);
+    return table->load_block(number, handle, nullptr, block, stored) == Status::OK && block.count == handle.count;
+}
+
+void SSTable::Iterator::stop(size_t found) {
+    if (found != table->block_count) read_status = Status::CORRUPTION;
+    block_number = table->block_count;
+    index = table->table_header.kv_count;
+}
+
+void SSTable::Iterator::settle() {
+    if (table->table_header.version == LEGACY_FORMAT || !valid()) return;
+    if (block_number < table->block_count &&
+        index >= handle.first_index && index < handle.first_index + handle.count) return;
+    BlockHandle found_handle;
+    size_t found = table->block_of(index, found_handle);
+    if (found == BROKEN_INDEX || !load(found, found_handle)) stop(found);
+}
+
+Status SSTable::Iterator::status() const {
+    return read_status;
+}
+
+bool SSTable::Iterator::valid() const {
+    return index < table->table_header.kv_count;
+}
+
+void SSTable::Iterator::seek_to_first() {
+    index = 0;
+    settle();
+}
+
+void SSTable::Iterator::seek_to_last() {
+    index = table->table_header.kv_count - 1;
+    settle();
+}
+
+void SSTable::Iterator::seek(uint64_t key) {
+    if (table->table_header.version == LEGACY_FORMAT) {
+        index = table->index_keys.lower_bound(key);
+        return;
+    }
+    BlockHandle found_handle;
+    size_t found = table->find_block(key, found_handle);
+    if (found == table->block_count || found == BROKEN_INDEX ||
+        (found != block_number && !load(found, found_handle))) {
+        stop(found);
+        return;
+    }
+    // the block holds a key >= key, so the position is inside it
+    index = handle.first_index + block.lower_bound(key);
+}
+
+void SSTable::Iterator::seek_for_prev(uint64_t key) {
+    seek(key);
+    if (!valid() || this->key() != key) prev();
+}
+
+void SSTable::Iterator::next() {
+    index++;
+    settle();
+}
+
+void SSTable::Iterator::prev() {
+    index = index ? index - 1 : table->table_header.kv_count;
+    settle();
+}
+
+uint64_t SSTable::Iterator::key() const {
+    if (table->table_header.version == LEGACY_FORMAT) {
+        return table->index_keys[index];
+    }
+    return block.key((uint32_t)(index - handle.first_index));
+}
+
+Slice SSTable::Iterator::value() {
+    if (table->table_header.version != LEGACY_FORMAT) {
+        return block.value((uint32_t)(index - handle.first_index));
+    }
+    size_t cur_offset = table->value_offsets[index];
+    size_t cur_length = table->value_length(index);
+    if (const char *mapped = table->mapping()) {
+        return Slice(mapped + table->header_offset + cur_offset, cur_length);
+    }
+    if (const char *ahead = read_ahead(table->header_offset + cur_offset, cur_length)) {
+        return Slice(ahead, cur_length);
+    }
+    buffer.resize(cur_length);
+    if (!table->read_at(table->header_offset + cur_offset, &buffer[0], cur_length)) {
+        read_status = Status::CORRUPTION;
+        buffer.clear();
+    }
+    return Slice(buffer);
+}
@@ -1,152 +1,266 @@
 #include "SkipList.h"
 #include <vector>
 #include <random>
+#include <new>
+#include <cstring>
 
 SkipList::SkipList() {
-    head = new ListNode();
-    lowest_head = head;
-}
-
-SkipList::~SkipList() {
-    ListNode *del_head = head;
-    while (del_head) {
-        ListNode *cur_node = del_head;
-        del_head = del_head->below;
-        while (cur_node) {
-            ListNode *del_node = cur_node;
-            cur_node = cur_node->next;
-            delete del_node;
-        }
+    init();
+}
+
+void SkipList::init() {
+    head = new_node(0, nullptr, MAX_HEIGHT);
+    max_height = 1;
+    data_count = 0;
+    byte_size = cal_size(0, 0);
+}
+
+SkipList::Node *SkipList::new_node(uint64_t key, const Value *value, int height) {
+    char *mem = arena.allocate(sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
+    Node *node = new (mem) Node(key, value);
+    for (int level = 1; level < height; ++level) {
+        new (&node->next[level]) std::atomic<Node*>(nullptr);
     }
+    return node;
+}
+
+const SkipList::Value *SkipList::new_value(const std::string &value) {
+    char *mem = arena.allocate(sizeof(Value) + value.size());
+    auto *stored = new (mem) Value(value.size());
+    memcpy(mem + sizeof(Value), value.data(), value.size());
+    return stored;
 }
 
-ListNode *SkipList::find(uint64_t key) {
-    ListNode *target = head;
-    while (target) {
-        while (target->next && target->next->key < key) {
-            target = target->next;
+int SkipList::random_height() {
+    // each level is kept with probability 1/4
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    int height = 1;
+    while (height < MAX_HEIGHT && (rng() & 3) == 0) {
+        height++;
+    }
+    return height;
+}
+
+bool SkipList::reserve(int64_t delta) {
+    uint64_t cur_size = byte_size.load(std::memory_order_relaxed);
+    do {
+        if (delta > 0 && cur_size + delta > MAX_BYTE_SIZE) {
+            return false;
         }
-        if (target->next && target->next->key == key) {
-            return target->next;
+    } while (!byte_size.compare_exchange_weak(cur_size, cur_size + delta, std::memory_order_relaxed));
+    return true;
+}
+
+void SkipList::find_splice(uint64_t key, Node **prev, Node **next, int height) const {
+    Node *cur_node = head;
+    for (int level = height - 1; level >= 0; --level) {
+        Node *next_node = cur_node->next[level].load(std::memory_order_acquire);
+        while (next_node && next_node->key < key) {
+            cur_node = next_node;
+            next_node = cur_node->next[level].load(std::memory_order_acquire);
         }
-        target = target->below;
+        prev[level] = cur_node;
+        next[level] = next_node;
     }
-    return nullptr;
 }
 
-std::string SkipList::get(uint64_t key) {
-    ListNode *find_node = find(key);
-    if (find_node) {
-        return find_node->value;
-    } else {
-        return "";
+bool SkipList::link(Node *node, int level, Node **prev, Node **next) {
+    while (true) {
+        node->next[level].store(next[level], std::memory_order_relaxed);
+        if (prev[level]->next[level].compare_exchange_strong(next[level], node,
+                std::memory_order_release, std::memory_order_acquire)) {
+            return true;
+        }
+        // nodes are never removed, so the new position is still after prev
+        Node *cur_node = prev[level];
+        Node *next_node = cur_node->next[level].load(std::memory_order_acquire);
+        while (next_node && next_node->key < node->key) {
+            cur_node = next_node;
+            next_node = cur_node->next[level].load(std::memory_order_acquire);
+        }
+        if (next_node && next_node->key == node->key) {
+            return false;
+        }
+        prev[level] = cur_node;
+        next[level] = next_node;
     }
 }
 
-bool SkipList::put(uint64_t key, const std::string& value) {
-    std::vector<ListNode*> path_list;
-    ListNode *hot = head;
-    while (hot) {
-        while (hot->next && hot->next->key < key) {
-            hot = hot->next;
+bool SkipList::update(Node *node, const std::string &value) {
+    const Value *old_value = node->value.load(std::memory_order_acquire);
+    while (true) {
+        int64_t delta = (int64_t)value.size() - (int64_t)old_value->size;
+        if (!reserve(delta)) {
+            return false;
         }
-        if (hot->next && hot->next->key == key) {
-            // handle coverage
-            hot = hot->next;
-            size_t old_length = hot->value.size();
-            uint64_t pred_length = data_total_length + value.size() - old_length;
-            if (cal_size(data_count, pred_length) > MAX_BYTE_SIZE) {
-                return false;
-            }
-            while (hot) {
-                hot->value = value;
-                hot = hot->below;
-            }
-            data_total_length = pred_length;
+        const Value *stored = new_value(value);
+        if (node->value.compare_exchange_strong(old_value, stored,
+                std::memory_order_acq_rel, std::memory_order_acquire)) {
             return true;
         }
-        path_list.push_back(hot);
-        hot = hot->below;
+        // lost to another writer, retry against its value (stored is left in the Arena)
+        reserve(-delta);
     }
+}
 
-    uint64_t pred_length = data_total_length + value.size();
-    if (cal_size(data_count + 1, pred_length) > MAX_BYTE_SIZE) {
-        return false;
+SkipList::Node *SkipList::find_greater_or_equal(uint64_t key) const {
+    Node *cur_node = head;
+    Node *next_node = nullptr;
+    for (int level = max_height.load(std::memory_order_relaxed) - 1; level >= 0; --level) {
+        next_node = cur_node->next[level].load(std::memory_order_acquire);
+        while (next_node && next_node->key < key) {
+            cur_node = next_node;
+            next_node = cur_node->next[level].load(std::memory_order_acquire);
+        }
     }
+    return next_node;
+}
 
-    // handle insert
-    bool isUp = true;
-    ListNode *below_node = nullptr;
-    while (isUp && !path_list.empty()) {
-        ListNode *prev_node = path_list.back();
-        path_list.pop_back();
-        auto *new_node = new ListNode(key, value);
-        new_node->insertAfterAbove(prev_node, below_node);
-        below_node = new_node;
-        isUp = (rand() & 1);
+SkipList::Node *SkipList::find_less_than(uint64_t key) const {
+    Node *cur_node = head;
+    for (int level = max_height.load(std::memory_order_relaxed) - 1; level >= 0; --level) {
+        Node *next_node = cur_node->next[level].load(std::memory_order_acquire);
+        while (next_node && next_node->key < key) {
+            cur_node = next_node;
+            next_node = cur_node->next[level].load(std::memory_order_acquire);
+        }
     }
-    if (isUp) {
-        ListNode *old_head = head;
-        head = new ListNode();
-        auto *new_node = new ListNode(key, value);
-        new_node->insertAfterAbove(head, below_node);
-        head->below = old_head;
+    return cur_node;
+}
+
+SkipList::Node *SkipList::find_last() const {
+    Node *cur_node = head;
+    for (int level = max_height.load(std::memory_order_relaxed) - 1; level >= 0; --level) {
+        Node *next_node = cur_node->next[level].load(std::memory_order_acquire);
+        while (next_node) {
+            cur_node = next_node;
+            next_node = cur_node->next[level].load(std::memory_order_acquire);
+        }
     }
-    data_count++;
-    data_total_length = pred_length;
-    return true;
+    return cur_node;
 }
 
-bool SkipList::remove(uint64_t key) {
+std::string SkipList::get(uint64_t key) const {
+    Slice value;
+    return get(key, value) ? value.to_string() : "";
+}
 
-    ListNode *top_target = find(key);
-    if (!top_target) return false;
-    uint64_t str_length = top_target->value.size();
-    while (top_target) {
-        ListNode *next = top_target->next;
-        ListNode *prev = top_target->prev;
-        ListNode *del_node = top_target;
-        top_target = top_target->below;
-        if (next) next->prev = prev;
-        if (prev) prev->next = next;
-        delete del_node;
+bool SkipList::get(uint64_t key, Slice &value) const {
+    Node *find_node = find_greater_or_equal(key);
+    if (find_node && find_node->key == key) {
+        const Value *stored = find_node->value.load(std::memory_order_acquire);
+        value = Slice(stored->data(), stored->size);
+        return true;
     }
-    data_count--;
-    data_total_length -= str_length;
-    return true;
+    return false;
+}
+
+bool SkipList::put(uint64_t key, const std::string& value) {
+    Node *prev[MAX_HEIGHT], *next[MAX_HEIGHT];
+    while (true) {
+        int cur_height = max_height.load(std::memory_order_relaxed);
+        find_splice(key, prev, next, cur_height);
+        if (next[0] && next[0]->key == key) {
+            // handle coverage
+            return update(next[0], value);
+        }
 
+        // handle insert
+        int64_t delta = (int64_t)(cal_size(1, value.size()) - cal_size(0, 0));
+        if (!reserve(delta)) {
+            return false;
+        }
+        int height = random_height();
+        for (int level = cur_height; level < height; ++level) {
+            prev[level] = head;
+            next[level] = nullptr;
+        }
+        while (height > cur_height &&
+               !max_height.compare_exchange_weak(cur_height, height, std::memory_order_relaxed)) {}
+
+        Node *node = new_node(key, new_value(value), height);
+        // level-0 decides which writer owns the key, higher levels cannot conflict
+        if (!link(node, 0, prev, next)) {
+            // node is left unused in the Arena
+            reserve(-delta);
+            continue;
+        }
+        for (int level = 1; level < height; ++level) {
+            link(node, level, prev, next);
+        }
+        data_count++;
+        return true;
+    }
 }
 
-std::vector<value_type> *SkipList::exported_data() {
+std::vector<value_type> *SkipList::exported_data() const {
     auto *data_set = new std::vector<value_type>();
-    ListNode *cur_data = head;
-    while (cur_data->below) {
-        cur_data = cur_data->below; // find the lowest layer
-    }
-    cur_data = cur_data->next;
-    while (cur_data) {
-        data_set->push_back(std::make_pair(cur_data->key, cur_data->value));
-        cur_data = cur_data->next;
+    for (Iterator itr(*this); itr.valid(); itr.next()) {
+        data_set->push_back(std::make_pair(itr.key(), itr.value().to_string()));
     }
     return data_set;
 }
 
-ListNode *SkipList::get_bottom_head() {
-    return lowest_head;
-}
-
 uint64_t SkipList::mem_size() const {
-    return cal_size(data_count, data_total_length);
+    return byte_size;
 }
 
 uint64_t SkipList::get_kv_count() const {
     return data_count;
 }
 
+size_t SkipList::get_memory_usage() const {
+    return arena.get_memory_usage();
+}
+
 void SkipList::clear() {
-    this->~SkipList();
-    head = new ListNode();
-    lowest_head = head;
-    data_count = 0;
-    data_total_length = 0;
-}
\ No newline at end of file
+    arena.clear();
+    init();
+}
+
+SkipList::Iterator::Iterator(const SkipList &l):
+    list(&l), node(l.head->next[0].load(std::memory_order_acquire)) {}
+
+bool SkipList::Iterator::valid() const {
+    return node != nullptr;
+}
+
+void SkipList::Iterator::seek_to_first() {
+    node = list->head->next[0].load(std::memory_order_acquire);
+}
+
+void SkipList::Iterator::seek_to_last() {
+    node = list->find_last();
+    if (node == list->head) node = nullptr;
+}
+
+void SkipList::Iterator::seek(uint64_t key) {
+    node = list->find_greater_or_equal(key);
+}
+
+void SkipList::Iterator::seek_for_prev(uint64_t key) {
+    seek(key);
+    if (!node || node->key != key) {
+        node = list->find_less_than(key);
+        if (node == list->head) node = nullptr;
+    }
+}
+
+void SkipList::Iterator::next() {
+    node = node->next[0].load(std::memory_order_acquire);
+}
+
+void SkipList::Iterator::prev() {
+    // no backward links, search for the predecessor instead
+    node = list->find_less_than(node->key);
+    if (node == list->head) node = nullptr;
+}
+
+uint64_t SkipList::Iterator::key() const {
+    return node->key;
+}
+
+Slice SkipList::Iterator::value() {
+    const Value *value = node->value.load(std::memory_order_acquire);
+    return Slice(value->data(), value->size);
+}
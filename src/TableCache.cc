@@ -0,0 +1,10 @@
+#include "TableCache.h"
+
+TableCache::TableCache(const Options &options):
+    files(options.max_open_files), mmap_reads(options.mmap_reads),
+    metadata(options.table_metadata_capacity) {}
+
+std::shared_ptr<TableCache> TableCache::standalone() {
+    static std::shared_ptr<TableCache> cache = std::make_shared<TableCache>();
+    return cache;
+}
@@ -0,0 +1,49 @@
+#include "Version.h"
+
+size_t Version::level_count() const {
+    return levels.size();
+}
+
+const Level &Version::get_level(size_t index) const {
+    return levels[index];
+}
+
+Level &Version::edit_level(size_t index) {
+    return levels[index];
+}
+
+void Version::add_level(const Level &new_level) {
+    levels.push_back(new_level);
+}
+
+Status Version::get(uint64_t key, PinnedValue &value, BlockCache *cache, size_t &probes) const {
+    for (auto &cur_level : levels) {
+        Status status = cur_level.get(key, value, cache, probes);
+        if (status != Status::NOT_FOUND) return status;
+    }
+    return Status::NOT_FOUND;
+}
+
+void Version::add_iterators(std::vector<std::unique_ptr<Iterator>> &iters, uint64_t start, uint64_t end) const {
+    for (auto &cur_level : levels) {
+        cur_level.add_iterators(iters, start, end);
+    }
+}
+
+bool Version::check_overlap() const {
+    for (size_t index = 1; index < levels.size(); ++index) {
+        if (!levels[index].check_overlap())
+            return false;
+    }
+    return true;
+}
+
+VersionSet::VersionSet(): current_version(std::make_shared<const Version>()) {}
+
+version_ptr VersionSet::current() const {
+    return std::atomic_load(&current_version);
+}
+
+void VersionSet::install(const version_ptr &new_version) {
+    std::atomic_store(&current_version, new_version);
+}
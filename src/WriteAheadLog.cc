@@ -0,0 +1,205 @@
+#include <fcntl.h>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include "WriteAheadLog.h"
+#include "utils.h"
+
+/*
+ * Record layout: | crc32 (4) | value length (4) | key (8) | value |
+ * crc32 covers key and value.
+ */
+static const size_t RECORD_HEADER_SIZE = 16;
+
+static void encode_record(std::string &dst, uint64_t key, const std::string &value) {
+    char header[RECORD_HEADER_SIZE];
+    auto length = (uint32_t)value.size();
+    memcpy(header + 4, &length, 4);
+    memcpy(header + 8, &key, 8);
+    std::string body(header + 8, 8);
+    body += value;
+    uint32_t crc = crc32(body.data(), body.size());
+    memcpy(header, &crc, 4);
+    dst.append(header, 8);
+    dst += body;
+}
+
+WriteAheadLog::WriteAheadLog(const std::string &d, SyncMode mode, uint64_t interval_ms):
+    dir(d), sync_mode(mode), sync_interval_ms(interval_ms), log_number(1), log_fd(-1) {
+    std::vector<uint64_t> logs = list_logs();
+    if (!logs.empty()) log_number = logs.back() + 1;
+    open_log(log_number);
+    if (sync_mode == SyncMode::PERIODIC) {
+        sync_thread = std::thread(&WriteAheadLog::sync_loop, this);
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        std::unique_lock<std::mutex> lock(log_mutex);
+        stopping = true;
+        sync_cv.wait(lock, [this] { return !sync_active; });
+    }
+    sync_cv.notify_all();
+    if (sync_thread.joinable()) sync_thread.join();
+    sync_log(log_fd);
+    close(log_fd);
+}
+
+std::string WriteAheadLog::log_path(uint64_t number) const {
+    return dir + "/" + my_itoa(number) + ".log";
+}
+
+std::vector<uint64_t> WriteAheadLog::list_logs() const {
+    std::vector<std::string> dir_list;
+    std::vector<uint64_t> logs;
+    utils::scanDir(dir, dir_list);
+    for (const auto &file_str : dir_list) {
+        size_t last_index = file_str.find_last_of('.');
+        if (last_index == std::string::npos || last_index == 0 ||
+            file_str.substr(last_index) != ".log")
+            continue;
+        std::string number_str = file_str.substr(0, last_index);
+        if (number_str.find_first_not_of("0123456789") != std::string::npos)
+            continue;
+        logs.push_back(std::stoull(number_str));
+    }
+    std::sort(logs.begin(), logs.end());
+    return logs;
+}
+
+void WriteAheadLog::open_log(uint64_t number) {
+    log_number = number;
+    log_fd = open(log_path(number).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log_fd < 0) {
+        // no write could be made durable from here on, stop before acknowledging any
+        perror(("WriteAheadLog::open_log " + log_path(number)).c_str());
+        std::abort();
+    }
+    // a synced record is lost with the file unless its directory entry is durable too
+    if (utils::syncPath(dir.c_str(), true) != 0) {
+        perror(("WriteAheadLog::open_log " + dir).c_str());
+        std::abort();
+    }
+}
+
+void WriteAheadLog::write_all(const std::string &buf) {
+    const char *ptr = buf.data();
+    size_t remain = buf.size();
+    while (remain) {
+        ssize_t written = write(log_fd, ptr, remain);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            // records of this batch may be half written, none of them can be acknowledged
+            perror("WriteAheadLog::write_all");
+            std::abort();
+        }
+        ptr += written;
+        remain -= written;
+    }
+}
+
+void WriteAheadLog::sync_log(int fd) {
+    if (utils::syncFile(fd) != 0) {
+        // after a failed fsync the kernel may have dropped the dirty pages, a retry proves nothing
+        perror("WriteAheadLog::sync_log");
+        std::abort();
+    }
+}
+
+void WriteAheadLog::sync_loop() {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    while (!stopping) {
+        sync_cv.wait_for(lock, std::chrono::milliseconds(sync_interval_ms));
+        if (dirty && !sync_active) {
+            // appends go on during the sync, rotate & clear wait for sync_active to close the file
+            int fd = log_fd;
+            dirty = false;
+            sync_active = true;
+            lock.unlock();
+            sync_log(fd);
+            lock.lock();
+            sync_active = false;
+            sync_cv.notify_all();
+        }
+    }
+}
+
+void WriteAheadLog::replay(const std::function<void(uint64_t, const std::string&)> &apply) {
+    for (uint64_t number : list_logs()) {
+        if (number >= log_number) break;
+        std::ifstream log_file(log_path(number), std::ios_base::in | std::ios_base::binary);
+        std::string content((std::istreambuf_iterator<char>(log_file)),
+                            std::istreambuf_iterator<char>());
+        size_t pos = 0;
+        while (pos + RECORD_HEADER_SIZE <= content.size()) {
+            uint32_t crc, length;
+            uint64_t key;
+            memcpy(&crc, content.data() + pos, 4);
+            memcpy(&length, content.data() + pos + 4, 4);
+            if (pos + RECORD_HEADER_SIZE + length > content.size()) break;
+            if (crc32(content.data() + pos + 8, 8 + length) != crc) break;
+            memcpy(&key, content.data() + pos + 8, 8);
+            apply(key, content.substr(pos + RECORD_HEADER_SIZE, length));
+            pos += RECORD_HEADER_SIZE + length;
+        }
+    }
+}
+
+void WriteAheadLog::append(uint64_t key, const std::string &value) {
+    append(std::vector<record_ref>{record_ref(key, &value)});
+}
+
+void WriteAheadLog::append(const std::vector<record_ref> &records) {
+    if (records.empty()) return;
+    std::unique_lock<std::mutex> lock(log_mutex);
+    if (sync_mode == SyncMode::EVERY_WRITE) {
+        for (auto &record : records) {
+            std::string encoded;
+            encode_record(encoded, record.first, *record.second);
+            write_all(encoded);
+            sync_log(log_fd);
+        }
+        return;
+    }
+    // records of concurrent writers arrive together, batched by the writer queue of KVStore
+    std::string batch;
+    for (auto &record : records) encode_record(batch, record.first, *record.second);
+    write_all(batch);
+    if (sync_mode == SyncMode::GROUP_COMMIT) sync_log(log_fd);
+    else dirty = true;
+}
+
+uint64_t WriteAheadLog::rotate() {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    sync_cv.wait(lock, [this] { return !sync_active; });
+    sync_log(log_fd);
+    dirty = false;
+    close(log_fd);
+    open_log(log_number + 1);
+    sync_cv.notify_all();
+    return log_number;
+}
+
+void WriteAheadLog::remove_logs_before(uint64_t number) {
+    for (uint64_t old_number : list_logs()) {
+        if (old_number >= number) break;
+        utils::rmfile(log_path(old_number).c_str());
+    }
+}
+
+void WriteAheadLog::clear() {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    sync_cv.wait(lock, [this] { return !sync_active; });
+    dirty = false;
+    close(log_fd);
+    for (uint64_t old_number : list_logs()) {
+        utils::rmfile(log_path(old_number).c_str());
+    }
+    open_log(1);
+    sync_cv.notify_all();
+}
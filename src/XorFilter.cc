@@ -0,0 +1,117 @@
+#include <cstring>
+#include <algorithm>
+#include "XorFilter.h"
+
+namespace {
+    // | seed (8) | fingerprint (1) per slot, in three segments of equal length |
+    const size_t SEED_SIZE = 8;
+    // peeling fails with a small probability, retried with other seeds
+    const int MAX_ATTEMPTS = 64;
+
+    uint64_t hash_key(uint64_t key, uint64_t seed) {
+        // MurmurHash3 finalizer: a bijection, distinct keys never share a hash
+        key += seed;
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    uint8_t fingerprint(uint64_t hash) {
+        return (uint8_t)(hash ^ (hash >> 32));
+    }
+
+    uint64_t rotl(uint64_t x, int r) {
+        // masked, so r = 0 does not shift by 64
+        return (x << r) | (x >> ((64 - r) & 63));
+    }
+
+    /**
+     * Slots of hash, one in each segment of segment_length.
+     */
+    void get_slots(uint64_t hash, uint32_t segment_length, uint32_t slots[3]) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            auto h = (uint32_t)rotl(hash, (int)(i * 21));
+            slots[i] = (uint32_t)(((uint64_t)h * segment_length) >> 32) + i * segment_length;
+        }
+    }
+}
+
+bool xor_filter::build(const std::vector<uint64_t> &keys, std::string &filter) {
+    filter.clear();
+    if (keys.empty()) return false;
+    auto segment_length = (uint32_t)((32 + keys.size() * 123 / 100) / 3 + 1);
+    size_t slot_count = (size_t)segment_length * 3;
+
+    // xor of the hashes mapped to a slot, and their number
+    std::vector<uint64_t> hash_xor(slot_count);
+    std::vector<uint32_t> count(slot_count);
+    std::vector<uint32_t> queue;
+    // peeled hashes with the slot each one owns, in peeling order
+    std::vector<std::pair<uint64_t, uint32_t>> stack;
+    queue.reserve(slot_count);
+    stack.reserve(keys.size());
+
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    uint32_t slots[3];
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt, seed = hash_key(seed, attempt)) {
+        std::fill(hash_xor.begin(), hash_xor.end(), 0);
+        std::fill(count.begin(), count.end(), 0);
+        queue.clear();
+        stack.clear();
+
+        for (uint64_t key : keys) {
+            uint64_t hash = hash_key(key, seed);
+            get_slots(hash, segment_length, slots);
+            for (uint32_t slot : slots) {
+                hash_xor[slot] ^= hash;
+                ++count[slot];
+            }
+        }
+        for (uint32_t slot = 0; slot < slot_count; ++slot) {
+            if (count[slot] == 1) queue.push_back(slot);
+        }
+        // a slot with a single key left is owned by it, removing the key may free others
+        while (!queue.empty()) {
+            uint32_t slot = queue.back();
+            queue.pop_back();
+            if (count[slot] != 1) continue;
+            uint64_t hash = hash_xor[slot];
+            stack.emplace_back(hash, slot);
+            get_slots(hash, segment_length, slots);
+            for (uint32_t other : slots) {
+                hash_xor[other] ^= hash;
+                if (--count[other] == 1) queue.push_back(other);
+            }
+        }
+        if (stack.size() == keys.size()) break;
+    }
+    if (stack.size() != keys.size()) return false;
+
+    // assigned in reverse peeling order, so the owned slot is the last one written
+    filter.assign(SEED_SIZE + slot_count, '\0');
+    memcpy(&filter[0], &seed, SEED_SIZE);
+    auto *fingerprints = (uint8_t*)&filter[SEED_SIZE];
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+        get_slots(it->first, segment_length, slots);
+        fingerprints[it->second] = 0;
+        fingerprints[it->second] = (uint8_t)(fingerprint(it->first) ^ fingerprints[slots[0]] ^
+                                             fingerprints[slots[1]] ^ fingerprints[slots[2]]);
+    }
+    return true;
+}
+
+bool xor_filter::may_contain(const char *filter, size_t size, uint64_t key) {
+    if (size < SEED_SIZE + 3) return true;
+    uint64_t seed;
+    memcpy(&seed, filter, SEED_SIZE);
+    auto segment_length = (uint32_t)((size - SEED_SIZE) / 3);
+    auto *fingerprints = (const uint8_t*)filter + SEED_SIZE;
+
+    uint64_t hash = hash_key(key, seed);
+    uint32_t slots[3];
+    get_slots(hash, segment_length, slots);
+    return fingerprint(hash) == (fingerprints[slots[0]] ^ fingerprints[slots[1]] ^ fingerprints[slots[2]]);
+}
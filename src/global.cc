@@ -13,31 +13,10 @@ std::string my_itoa(uint64_t tmp) {
     return tmp_string;
 }
 
-void ListNode::insertAfterAbove(ListNode *p, ListNode *b){
-    // above node doesn't exists
-    ListNode *n = nullptr;
-    if (p) {
-        n = p->next;
-        p->next = this;
-    }
-    if (n) { n->prev = next; }
-    this->prev = p;
-    this->next = n;
-    this->below = b;
-}
-
 bool in_scope(std::pair<uint64_t, uint64_t> scope, uint64_t key) {
     return key >= scope.first && key <= scope.second;
 }
 
-bool operator<(MergeInfo a, MergeInfo b) {
-    if (a.min_key == b.min_key)
-        // smaller time stamp -> later popped
-        return a.time_stamp < b.time_stamp;
-    // smaller key -> earlier popped
-    return a.min_key > b.min_key;
-}
-
 char* substr(const char* str, unsigned start, unsigned end) {
     unsigned n = end - start;
     static char buf[256];
@@ -52,4 +31,26 @@ bool sst_suffix(const char* filePath) {
     long pos = ptr - filePath;
     char *fileExt = substr(filePath, pos+1, strlen(filePath));
     return !strcmp(fileExt,"sst");
+}
+
+namespace {
+    struct Crc32Table {
+        uint32_t entry[256];
+        Crc32Table() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                entry[i] = c;
+            }
+        }
+    };
+}
+
+uint32_t crc32(const char *data, size_t n) {
+    static const Crc32Table table;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < n; ++i)
+        crc = table.entry[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
 }
\ No newline at end of file
@@ -1,45 +1,263 @@
 #include "kvstore.h"
 #include <string>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
 
 
 KVStore::KVStore(const std::string &dir):
-    KVStoreAPI(dir), diskStore(DiskRepo(dir)) {}
+    KVStore(dir, Options()) {}
+
+KVStore::KVStore(const std::string &dir, const Options &options):
+    KVStoreAPI(dir), memTable(std::make_shared<SkipList>()), diskStore(dir, options),
+    wal(dir, options.sync_mode, options.sync_interval_ms),
+    max_immutable(options.max_immutable_memtables ? options.max_immutable_memtables : 1),
+    max_batch(options.max_write_batch ? options.max_write_batch : 1) {
+    publish_memtables();
+    flush_thread = std::thread(&KVStore::flush_loop, this);
+    // old logs are kept until the replayed data reaches an SSTable
+    wal.replay([this](uint64_t key, const std::string &s) {
+        if (!memTable->put(key, s)) {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            seal_memtable(lock, 0);
+            memTable->put(key, s);
+        }
+    });
+}
 
 KVStore::~KVStore() {
-    diskStore.push_table(&memTable);
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+    flush_cv.notify_all();
+    flush_thread.join();
+    bool flushed = diskStore.push_table(memTable.get());
+    uint64_t next_log = wal.rotate();
+    if (flushed && !keep_logs) wal.remove_logs_before(next_log);
+}
+
+void KVStore::seal_memtable(std::unique_lock<std::mutex> &lock, uint64_t log_number) {
+    room_cv.wait(lock, [this] { return immTables.size() < max_immutable; });
+    immTables.push_back(ImmutableTable{memTable, log_number});
+    memTable = std::make_shared<SkipList>();
+    publish_memtables();
+    flush_cv.notify_all();
+}
+
+void KVStore::publish_memtables() {
+    auto published = std::make_shared<MemTables>();
+    published->reserve(immTables.size() + 1);
+    published->push_back(memTable);
+    for (auto imm = immTables.rbegin(); imm != immTables.rend(); ++imm) {
+        published->push_back(imm->table);
+    }
+    std::atomic_store(&mem_tables, std::shared_ptr<const MemTables>(std::move(published)));
+}
+
+void KVStore::flush_loop() {
+    std::unique_lock<std::mutex> lock(state_mutex);
+    while (true) {
+        flush_cv.wait(lock, [this] { return stopping || !immTables.empty(); });
+        if (immTables.empty()) break; // stopping, and nothing left to flush
+        ImmutableTable oldest = immTables.front();
+        bool remove_logs = oldest.log_number && !keep_logs;
+        lock.unlock();
+        bool flushed = diskStore.push_table(oldest.table.get());
+        // everything logged before this table was sealed is in SSTables now
+        if (flushed && remove_logs) wal.remove_logs_before(oldest.log_number);
+        lock.lock();
+        if (!flushed) {
+            if (!stopping) {
+                // the table stays readable in memory and its logs are kept, try again later
+                flush_cv.wait_for(lock, std::chrono::seconds(1));
+                continue;
+            }
+            // given up on shutdown, replayed from its logs on the next start
+            keep_logs = true;
+        }
+        immTables.pop_front();
+        publish_memtables();
+        room_cv.notify_all();
+    }
+}
+
+void KVStore::write(Writer &w)
+{
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    writers.push_back(&w);
+    w.cv.wait(lock, [&] { return w.done || writers.front() == &w; });
+    if (w.done) return;
+
+    // leader: take adjacent puts / dels behind us, a reset is applied alone
+    std::vector<Writer*> batch{&w};
+    if (w.value) {
+        auto itr = writers.begin() + 1;
+        while (itr != writers.end() && batch.size() < max_batch && (*itr)->value) {
+            batch.push_back(*itr++);
+        }
+    }
+    lock.unlock();
+    if (w.value) apply_batch(batch);
+    else clear_all();
+    lock.lock();
+
+    for (auto member : batch) {
+        writers.pop_front();
+        member->done = true;
+        member->cv.notify_one();
+    }
+    if (!writers.empty()) writers.front()->cv.notify_one();
+}
+
+void KVStore::apply_batch(const std::vector<Writer*> &batch)
+{
+    // bytes a pair adds to memTable as a new key, an overwrite takes less
+    auto pair_size = [&](size_t i) { return cal_size(1, batch[i]->value->size()) - cal_size(0, 0); };
+    size_t begin = 0;
+    while (begin < batch.size()) {
+        // pairs that surely fit
+        uint64_t used = memTable->mem_size();
+        size_t end = begin;
+        while (end < batch.size() && used + pair_size(end) <= MAX_BYTE_SIZE) {
+            used += pair_size(end++);
+        }
+        if (end == begin && memTable->get_kv_count()) {
+            // pairs already in the full memTable belong to the log rotated out here,
+            // synced before taking state_mutex so readers & the flush thread don't wait on it
+            uint64_t log_number = wal.rotate();
+            std::unique_lock<std::mutex> lock(state_mutex);
+            seal_memtable(lock, log_number);
+            continue;
+        }
+        // a pair too large even for an empty memTable is logged and offered to it alone
+        end = std::max(end, begin + 1);
+
+        // logged first, so no reader sees a pair that a crash could still lose
+        std::vector<WriteAheadLog::record_ref> records;
+        for (size_t i = begin; i < end; ++i) {
+            records.emplace_back(batch[i]->key, batch[i]->value);
+        }
+        wal.append(records);
+        for (; begin < end; ++begin) {
+            memTable->put(batch[begin]->key, *batch[begin]->value);
+        }
+    }
 }
 
 void KVStore::put(uint64_t key, const std::string &s)
 {
-    if (!memTable.put(key, s)) {
-        diskStore.push_table(&memTable);
-        memTable.clear();
-        memTable.put(key, s);
+    Writer w(key, &s);
+    write(w);
+}
+
+namespace {
+    /**
+     * Pin a value found in a memTable, unless it is a deletion.
+     */
+    bool pin_unless_deleted(const Slice &found, std::shared_ptr<const void> owner, PinnedValue &value)
+    {
+        if (found == "~DELETED~") {
+            value.reset();
+            return false;
+        }
+        value.pin(found, std::move(owner));
+        return true;
     }
 }
 
 std::string KVStore::get(uint64_t key)
 {
-	std::string mem_str = memTable.get(key);
-	if (!mem_str.empty()) {
-	    return mem_str == "~DELETED~" ? "" : mem_str;
-	} return diskStore.get(key);
+    PinnedValue value;
+    return get(key, value) ? value.release() : "";
+}
+
+bool KVStore::get(uint64_t key, PinnedValue &value)
+{
+    // memTable readers never block the writer, nor take any lock.
+    // A table leaves mem_tables only once it is on disk, so searching disk after it never misses data
+    std::shared_ptr<const MemTables> tables = std::atomic_load(&mem_tables);
+    Slice found;
+    for (auto &table : *tables) {
+        if (table->get(key, found) && found.size) {
+            return pin_unless_deleted(found, table, value);
+        }
+    }
+	return diskStore.get(key, value) == Status::OK;
 }
 
 bool KVStore::del(uint64_t key)
 {
     bool is_exist = !get(key).empty();
 	if (is_exist) {
-        memTable.put(key, "~DELETED~");
+        static const std::string deleted_flag = "~DELETED~";
+        Writer w(key, &deleted_flag);
+        write(w);
 	} return is_exist;
 }
 
+const BlockCache *KVStore::get_block_cache() const
+{
+    return diskStore.get_block_cache();
+}
+
+uint64_t KVStore::get_table_probes() const
+{
+    return diskStore.get_table_probes();
+}
+
+uint64_t KVStore::get_read_errors() const
+{
+    return diskStore.get_read_errors();
+}
+
+std::unique_ptr<KVIterator> KVStore::new_iterator()
+{
+    return range_iterator(0, UINT64_MAX);
+}
+
+std::unique_ptr<KVIterator> KVStore::range_iterator(uint64_t start, uint64_t end)
+{
+    // same order as get: a table moving to disk meanwhile is seen at least once
+    MemTables tables = *std::atomic_load(&mem_tables);
+    std::vector<std::unique_ptr<Iterator>> sources;
+    for (auto &mem : tables) {
+        sources.emplace_back(new SkipList::Iterator(*mem));
+    }
+    diskStore.add_iterators(sources, start, end);
+    return std::unique_ptr<KVIterator>(new KVIterator(std::move(tables), std::move(sources)));
+}
+
+Status KVStore::scan(uint64_t start, uint64_t end,
+                     const std::function<void(uint64_t, const std::string&)> &visit)
+{
+    std::unique_ptr<KVIterator> itr = range_iterator(start, end);
+    for (itr->seek(start); itr->valid() && itr->key() <= end; itr->next()) {
+        visit(itr->key(), itr->value().to_string());
+    }
+    if (itr->status() != Status::OK) {
+        fprintf(stderr, "KVStore: scan of [%llu, %llu] stopped at a table that can't be read\n",
+                (unsigned long long)start, (unsigned long long)end);
+    }
+    return itr->status();
+}
+
 /**
  * This resets the kvstore. All key-value pairs should be removed,
  * including memtable and all sstables files.
  */
 void KVStore::reset()
 {
-    memTable.clear();
+    Writer w(0, nullptr);
+    write(w);
+}
+
+void KVStore::clear_all()
+{
+    std::unique_lock<std::mutex> lock(state_mutex);
+    room_cv.wait(lock, [this] { return immTables.empty(); });
+    memTable = std::make_shared<SkipList>();
+    publish_memtables();
     diskStore.clear();
+    wal.clear();
 }
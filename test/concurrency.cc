@@ -0,0 +1,185 @@
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
+
+#include "test.h"
+
+class ConcurrencyTest : public Test {
+private:
+	static const uint64_t TEST_MAX = 1024 * 32;
+	static const int NR_WRITERS = 4;
+	static const int NR_READERS = 4;
+
+	static std::string value_of(uint64_t key)
+	{
+		return std::string(key % 256 + 1, 'a' + key % 26);
+	}
+
+	/**
+	 * Run writer threads to completion while readers get keys in parallel.
+	 * A reader may see a key either absent or with its value,
+	 * and keys not deleted must stay visible while deleting.
+	 */
+	uint64_t run(void (ConcurrencyTest::*work)(int), bool deleting)
+	{
+		std::atomic<bool> writing(true);
+		std::atomic<uint64_t> wrong_reads(0);
+
+		std::vector<std::thread> readers;
+		for (int r = 0; r < NR_READERS; ++r) {
+			readers.emplace_back([&, r] {
+				uint64_t key = r;
+				while (writing) {
+					key = (key * 7 + 13) % TEST_MAX;
+					std::string got = store.get(key);
+					if (!got.empty() && got != value_of(key))
+						++wrong_reads;
+					if (deleting && (key & 1) && got.empty())
+						++wrong_reads;
+				}
+			});
+		}
+
+		std::vector<std::thread> writers;
+		for (int w = 0; w < NR_WRITERS; ++w)
+			writers.emplace_back(work, this, w);
+		for (auto &t : writers)
+			t.join();
+		writing = false;
+		for (auto &t : readers)
+			t.join();
+		return wrong_reads;
+	}
+
+	/**
+	 * Get every key with nr_readers threads at once, no writer running.
+	 * @return gets per second of all readers together
+	 */
+	double read_rate(int nr_readers)
+	{
+		std::atomic<uint64_t> wrong_reads(0);
+		auto begin = std::chrono::steady_clock::now();
+		std::vector<std::thread> readers;
+		for (int r = 0; r < nr_readers; ++r) {
+			readers.emplace_back([&, r] {
+				uint64_t key = r;
+				for (uint64_t i = 0; i < TEST_MAX; ++i) {
+					key = (key * 7 + 13) % TEST_MAX;
+					if (store.get(key) != value_of(key))
+						++wrong_reads;
+				}
+			});
+		}
+		for (auto &t : readers)
+			t.join();
+		auto elapsed = std::chrono::steady_clock::now() - begin;
+		EXPECT((uint64_t)0, (uint64_t)wrong_reads);
+		double seconds = std::chrono::duration<double>(elapsed).count();
+		return (double)TEST_MAX * nr_readers / seconds;
+	}
+
+	void put_keys(int w)
+	{
+		for (uint64_t i = w; i < TEST_MAX; i += NR_WRITERS)
+			store.put(i, value_of(i));
+	}
+
+	void del_keys(int w)
+	{
+		for (uint64_t i = 2 * w; i < TEST_MAX; i += 2 * NR_WRITERS)
+			store.del(i);
+	}
+
+	/**
+	 * Writer threads put into one memTable at once, all of them
+	 * also overwriting a shared range of keys.
+	 */
+	void memtable_test()
+	{
+		const uint64_t max = 1024 * 4;
+		SkipList mem_table;
+
+		std::vector<std::thread> writers;
+		for (int w = 0; w < NR_WRITERS; ++w) {
+			writers.emplace_back([&, w] {
+				for (uint64_t i = w; i < max; i += NR_WRITERS) {
+					mem_table.put(i, value_of(i));
+					mem_table.put(i % 64, value_of(i % 64));
+				}
+			});
+		}
+		for (auto &t : writers)
+			t.join();
+
+		EXPECT(max, mem_table.get_kv_count());
+		for (uint64_t i = 0; i < max; ++i)
+			EXPECT(value_of(i), mem_table.get(i));
+
+		uint64_t expected_key = 0;
+		for (SkipList::Iterator itr(mem_table); itr.valid(); itr.next())
+			EXPECT(expected_key++, itr.key());
+		EXPECT(max, expected_key);
+		phase();
+	}
+
+	void test()
+	{
+		uint64_t i;
+
+		memtable_test();
+
+		// Concurrent puts, with parallel readers
+		EXPECT((uint64_t)0, run(&ConcurrencyTest::put_keys, false));
+		for (i = 0; i < TEST_MAX; ++i)
+			EXPECT(value_of(i), store.get(i));
+		phase();
+
+		// Readers share no lock, more of them get more done
+		double single = read_rate(1);
+		double parallel = read_rate(NR_READERS);
+		std::cout << "  Gets per second: " << (uint64_t)single << " by 1 reader, ";
+		std::cout << (uint64_t)parallel << " by " << NR_READERS << " readers" << std::endl;
+		phase();
+
+		// Concurrent dels of even keys, with parallel readers
+		EXPECT((uint64_t)0, run(&ConcurrencyTest::del_keys, true));
+		for (i = 0; i < TEST_MAX; ++i)
+			EXPECT(i & 1 ? value_of(i) : not_found, store.get(i));
+		phase();
+
+		report();
+	}
+
+public:
+	ConcurrencyTest(const std::string &dir, bool v=true) : Test(dir, v)
+	{
+	}
+
+	void start_test(void *args = NULL) override
+	{
+		std::cout << "KVStore Concurrency Test" << std::endl;
+		store.reset();
+		test();
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+	std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+	std::cout << "  -v: print extra info for failed tests [currently ";
+	std::cout << (verbose ? "ON" : "OFF")<< "]" << std::endl;
+	std::cout << std::endl;
+	std::cout.flush();
+
+	ConcurrencyTest test("./data", verbose);
+
+	test.start_test();
+
+	return 0;
+}
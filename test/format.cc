@@ -0,0 +1,345 @@
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "test.h"
+#include "SSTable.h"
+#include "utils.h"
+
+class FormatTest : public Test {
+public:
+	// what is checked & written by start_test
+	enum Stage { UPGRADE, REOPEN, PARTITION, REWRITE, CORRUPT, LARGE };
+
+private:
+	static const uint64_t TEST_MAX = 1024 * 32;
+
+	const std::string dir;
+
+	static std::string legacy_value(uint64_t i)
+	{
+		return std::string(i % 512 + 1, 'a' + i % 26);
+	}
+
+	static std::string new_value(uint64_t i)
+	{
+		return std::string(i % 256 + 1, 'A' + i % 26);
+	}
+
+	/**
+	 * Value after both the legacy & the new writes.
+	 */
+	static std::string final_value(uint64_t i)
+	{
+		if (i < TEST_MAX && i % 7 == 0)
+			return not_found;
+		if (i >= TEST_MAX || i % 3 == 0)
+			return new_value(i);
+		return legacy_value(i);
+	}
+
+	/**
+	 * Count tables of each format stored in dir.
+	 */
+	void count_formats(uint64_t &legacy, uint64_t &block, uint64_t &partitioned)
+	{
+		legacy = block = partitioned = 0;
+		std::vector<std::string> levels;
+		utils::scanDir(dir, levels);
+		for (auto &level : levels) {
+			if (level.find("level-") != 0)
+				continue;
+			std::vector<std::string> tables;
+			utils::scanDir(dir + "/" + level, tables);
+			for (auto &table : tables) {
+				if (table.find(".sst") == std::string::npos)
+					continue;
+				SSTable stored(dir + "/" + level + "/" + table);
+				if (stored.get_format_version() == 1)
+					++legacy;
+				else
+					++block;
+				if (stored.is_partitioned())
+					++partitioned;
+			}
+		}
+	}
+
+	void write_new()
+	{
+		uint64_t i;
+		for (i = 0; i < TEST_MAX; i += 3)
+			store.put(i, new_value(i));
+		for (i = 0; i < TEST_MAX; i += 7)
+			store.del(i);
+		for (i = TEST_MAX; i < TEST_MAX * 2; ++i)
+			store.put(i, new_value(i));
+	}
+
+	/**
+	 * A broken data block is reported, not taken as the end of its table.
+	 */
+	void test_corrupt()
+	{
+		const uint64_t count = 4096;
+		std::string table_dir = dir + "/corrupt";
+		utils::mkdir(table_dir.c_str());
+		auto *data = new std::vector<value_type>;
+		for (uint64_t i = 0; i < count; ++i)
+			data->emplace_back(i, new_value(i));
+		std::string path = SSTable(data, 1, table_dir).get_table_path();
+
+		corrupt_file(path);
+
+		auto table = std::make_shared<SSTable>(path);
+		SSTable::Iterator itr(table);
+		uint64_t read = 0;
+		for (itr.seek_to_first(); itr.valid(); itr.next())
+			++read;
+		EXPECT(true, read < count);
+		EXPECT(true, itr.status() == Status::CORRUPTION);
+
+		// the first key of the broken block is neither found nor missing
+		PinnedValue value;
+		EXPECT(true, table->get(read, value) == Status::CORRUPTION);
+		EXPECT(true, table->get(0, value) == Status::OK);
+		EXPECT(new_value(0), value.value().to_string());
+		phase();
+
+		// a compaction can't go on without the rest of the table
+		std::vector<SSTable*> merged;
+		std::vector<std::shared_ptr<SSTable>> inputs{table};
+		EXPECT(true, merge_table(inputs, false, table_dir, TableOptions(), 2, 0, 0, UINT64_MAX,
+					 TableCache::standalone(), merged) == Status::CORRUPTION);
+		EXPECT(true, merged.empty());
+		std::vector<std::string> files;
+		utils::scanDir(table_dir, files);
+		EXPECT((size_t)1, files.size());
+		phase();
+
+		table.reset();
+		utils::rmfile(path.c_str());
+
+		// a value cut off the end of an open legacy table fails every get, none caches it
+		Options options;
+		options.table_format_version = 1;
+		data = new std::vector<value_type>;
+		for (uint64_t i = 0; i < count; ++i)
+			data->emplace_back(i, new_value(i));
+		path = SSTable(data, 1, table_dir, TableOptions(options)).get_table_path();
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		file.seekg(0, std::ios::end);
+		std::streamoff size = file.tellg();
+		file.close();
+		table = std::make_shared<SSTable>(path);
+		EXPECT(0, truncate(path.c_str(), size - 16));
+		BlockCache cache(1 << 20);
+		EXPECT(true, table->get(count - 1, value, &cache) == Status::CORRUPTION);
+		EXPECT(true, table->get(count - 1, value, &cache) == Status::CORRUPTION);
+		EXPECT(true, table->get(0, value, &cache) == Status::OK);
+		EXPECT(new_value(0), value.value().to_string());
+		phase();
+
+		table.reset();
+		remove_store(table_dir);
+		report();
+	}
+
+	/**
+	 * A pair too large for a table of its own size limit, as an empty memTable
+	 * still takes, is merged into a table of its own rather than lost.
+	 */
+	void test_large()
+	{
+		const uint64_t count = 1024;
+		const uint64_t large_key = count / 2;
+		const std::string large_value(MAX_BYTE_SIZE - 1024, 'L');
+		std::string table_dir = dir + "/large";
+		remove_store(table_dir);
+		utils::mkdir(table_dir.c_str());
+		std::vector<std::shared_ptr<SSTable>> inputs;
+		for (uint64_t t = 0; t < 2; ++t) {
+			auto *data = new std::vector<value_type>;
+			for (uint64_t i = t; i < count; i += 2)
+				data->emplace_back(i, i == large_key ? large_value : new_value(i));
+			inputs.push_back(std::make_shared<SSTable>(data, t + 1, table_dir));
+		}
+
+		std::vector<SSTable*> merged;
+		EXPECT(true, merge_table(inputs, false, table_dir, TableOptions(), 3, 0, 0, UINT64_MAX,
+					 TableCache::standalone(), merged) == Status::OK);
+		// pairs before the large one, the large one, pairs after it
+		EXPECT((size_t)3, merged.size());
+		uint64_t merged_count = 0;
+		PinnedValue value;
+		for (auto *table : merged) {
+			std::shared_ptr<SSTable> owned(table);
+			SSTable::Iterator itr(owned);
+			for (itr.seek_to_first(); itr.valid(); itr.next(), ++merged_count) {
+				EXPECT(merged_count, itr.key());
+				EXPECT(merged_count == large_key ? large_value : new_value(merged_count),
+				       itr.value().to_string());
+			}
+			owned->mark_obsolete();
+		}
+		EXPECT(count, merged_count);
+		phase();
+
+		for (auto &input : inputs)
+			input->mark_obsolete();
+		inputs.clear();
+		remove_store(table_dir);
+		report();
+	}
+
+	void test(Stage stage)
+	{
+		uint64_t i, legacy, block, partitioned;
+
+		if (stage == CORRUPT) {
+			test_corrupt();
+			return;
+		}
+		if (stage == LARGE) {
+			test_large();
+			return;
+		}
+
+		if (stage == UPGRADE) {
+			// Tables written by an older build are read as they are
+			count_formats(legacy, block, partitioned);
+			EXPECT(true, legacy > 0);
+			EXPECT((uint64_t)0, block);
+			for (i = 0; i < TEST_MAX; ++i)
+				EXPECT(legacy_value(i), store.get(i));
+			phase();
+
+			// New tables are merged with the old ones
+			write_new();
+			count_formats(legacy, block, partitioned);
+			EXPECT(true, block > 0);
+			EXPECT((uint64_t)0, partitioned);
+		} else if (stage == PARTITION) {
+			// Rewritten tables keep only their partition index in memory
+			write_new();
+			count_formats(legacy, block, partitioned);
+			EXPECT(true, partitioned > 0);
+		} else if (stage == REWRITE) {
+			write_new();
+		}
+
+		for (i = 0; i < TEST_MAX * 2; ++i)
+			EXPECT(final_value(i), store.get(i));
+		phase();
+
+		// Iterators cross block & table boundaries of both formats
+		auto itr = store.new_iterator();
+		uint64_t expected = 0;
+		for (itr->seek_to_first(); itr->valid(); itr->next(), ++expected) {
+			while (final_value(expected) == not_found)
+				++expected;
+			EXPECT(expected, itr->key());
+			EXPECT(final_value(expected), itr->value().to_string());
+		}
+		EXPECT(TEST_MAX * 2, expected);
+		phase();
+
+		report();
+	}
+
+public:
+	FormatTest(const std::string &dir, bool v=true, const Options &options=Options()) :
+		Test(dir, v, options), dir(dir)
+	{
+	}
+
+	/**
+	 * Fill a store at dir with tables of the legacy format.
+	 */
+	static void write_legacy(const std::string &dir)
+	{
+		Options options;
+		options.table_format_version = 1;
+		KVStore legacy_store(dir, options);
+		legacy_store.reset();
+
+		for (uint64_t i = 0; i < TEST_MAX; ++i)
+			legacy_store.put(i, legacy_value(i));
+	}
+
+	void start_test(void *args = NULL) override
+	{
+		Stage stage = args != NULL ? *(Stage *)args : REOPEN;
+		std::cout << "KVStore Table Format Test" << std::endl;
+		test(stage);
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+	std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+	std::cout << "  -v: print extra info for failed tests [currently ";
+	std::cout << (verbose ? "ON" : "OFF")<< "]" << std::endl;
+	std::cout << std::endl;
+	std::cout.flush();
+
+	FormatTest::write_legacy("./data");
+
+	{
+		std::cout << "[Blocks: LZ, read mode: pread]" << std::endl;
+		FormatTest::Stage stage = FormatTest::UPGRADE;
+		FormatTest test("./data", verbose);
+		test.start_test(&stage);
+	}
+
+	{
+		std::cout << "[Blocks: uncompressed, read mode: mmap]" << std::endl;
+		Options options;
+		options.table_compression = Compression::NONE;
+		options.mmap_reads = true;
+		FormatTest test("./data", verbose, options);
+		test.start_test();
+	}
+
+	{
+		std::cout << "[Blocks: LZ, index: partitioned, read mode: pread]" << std::endl;
+		Options options;
+		options.partition_index = true;
+		options.index_partition_size = 256;
+		options.table_metadata_capacity = 64 << 10;
+		FormatTest::Stage stage = FormatTest::PARTITION;
+		FormatTest test("./data", verbose, options);
+		test.start_test(&stage);
+	}
+
+	{
+		std::cout << "[Blocks: LZ, filter: xor below level-0, read mode: pread]" << std::endl;
+		Options options;
+		options.xor_filter_level = 1;
+		FormatTest::Stage stage = FormatTest::REWRITE;
+		FormatTest test("./data", verbose, options);
+		test.start_test(&stage);
+	}
+
+	{
+		std::cout << "[Blocks: LZ, one data block corrupted]" << std::endl;
+		FormatTest::Stage stage = FormatTest::CORRUPT;
+		FormatTest test("./data", verbose);
+		test.start_test(&stage);
+	}
+
+	{
+		std::cout << "[Blocks: LZ, a pair larger than a table]" << std::endl;
+		FormatTest::Stage stage = FormatTest::LARGE;
+		FormatTest test("./data", verbose);
+		test.start_test(&stage);
+	}
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include <vector>
+
+#include "test.h"
+#include "SSTable.h"
+#include "utils.h"
+
+class LookupTest : public Test {
+private:
+	static const uint64_t TEST_MAX = 1024 * 64;
+	static const uint64_t HOT_MAX = 1024;
+	static const uint64_t LAYERED_MAX = 1024 * 4;
+	static const uint64_t LAYERS = 4;
+
+	const std::string dir;
+
+	static std::string cold_value(uint64_t i)
+	{
+		return std::string(i % 256 + 1, 'c');
+	}
+
+	static std::string hot_value(uint64_t i)
+	{
+		return std::string(2048 + i % 64, 'h');
+	}
+
+	/**
+	 * Cold keys pushed down to the deeper levels, then hot keys
+	 * rewritten on top of them, some cold keys deleted last.
+	 */
+	void prepare()
+	{
+		uint64_t i;
+		store.reset();
+		for (i = 0; i < TEST_MAX; ++i)
+			store.put(i, cold_value(i));
+		for (i = 0; i < HOT_MAX; ++i)
+			store.put(i, hot_value(i));
+		for (i = HOT_MAX; i < TEST_MAX; i += 11)
+			store.del(i);
+	}
+
+	static std::string final_value(uint64_t i)
+	{
+		if (i < HOT_MAX)
+			return hot_value(i);
+		if (i % 11 == HOT_MAX % 11)
+			return not_found;
+		return cold_value(i);
+	}
+
+	/**
+	 * Get keys [start, end) rounds times.
+	 * @return tables probed per get
+	 */
+	double measure(const char *name, uint64_t start, uint64_t end, int rounds)
+	{
+		uint64_t probes = store.get_table_probes();
+		auto begin = std::chrono::steady_clock::now();
+		for (int round = 0; round < rounds; ++round) {
+			for (uint64_t i = start; i < end; ++i)
+				EXPECT(final_value(i), store.get(i));
+		}
+		auto elapsed = std::chrono::steady_clock::now() - begin;
+		double gets = (double)(end - start) * rounds;
+		double per_get = (double)(store.get_table_probes() - probes) / gets;
+		double us = std::chrono::duration<double, std::micro>(elapsed).count() / gets;
+		std::cout << "  " << name << " keys: " << per_get << " tables probed, ";
+		std::cout << us << " us per get" << std::endl;
+		return per_get;
+	}
+
+	static std::string layered_value(uint64_t i, uint64_t level)
+	{
+		return std::string(i % 64 + 1, '0' + level);
+	}
+
+	/**
+	 * One table per level, each covering [0, LAYERED_MAX]: level l holds
+	 * the keys i with i % LAYERS <= l, so a key's newest value lies
+	 * i % LAYERS levels down and every level above it covers the key.
+	 * Searching every level would probe LAYERS tables per get.
+	 */
+	void build_layers(const std::string &layered_dir)
+	{
+		// tables & log of the last run
+		remove_store(layered_dir);
+		utils::mkdir(layered_dir.c_str());
+		for (uint64_t l = 0; l < LAYERS; ++l) {
+			std::string level_dir = layered_dir + "/level-" + my_itoa(l);
+			utils::mkdir(level_dir.c_str());
+			auto *data = new std::vector<value_type>;
+			for (uint64_t i = 0; i <= LAYERED_MAX; ++i) {
+				if (i % LAYERS <= l)
+					data->emplace_back(i, layered_value(i, i % LAYERS));
+			}
+			// upper levels are newer
+			SSTable(data, LAYERS - l, level_dir);
+		}
+	}
+
+	/**
+	 * Each get probes the tables down to its key's level only.
+	 */
+	void test_layers()
+	{
+		std::string layered_dir = dir + "/layered";
+		build_layers(layered_dir);
+		// far below the default level targets: nothing gets compacted
+		KVStore layered(layered_dir, Options());
+		std::vector<uint64_t> probes(LAYERS, 0);
+		std::vector<uint64_t> gets(LAYERS, 0);
+		for (uint64_t i = 0; i <= LAYERED_MAX; ++i) {
+			uint64_t before = layered.get_table_probes();
+			EXPECT(layered_value(i, i % LAYERS), layered.get(i));
+			probes[i % LAYERS] += layered.get_table_probes() - before;
+			++gets[i % LAYERS];
+		}
+		for (uint64_t l = 0; l < LAYERS; ++l) {
+			std::cout << "  Keys " << l << " levels down: ";
+			std::cout << (double)probes[l] / gets[l] << " tables probed of ";
+			std::cout << LAYERS << std::endl;
+			EXPECT((l + 1) * gets[l], (uint64_t)probes[l]);
+		}
+	}
+
+	void test()
+	{
+		// Newest value wins although older ones stay in deeper levels
+		double hot = measure("Hot", 0, HOT_MAX, 16);
+		phase();
+
+		double cold = measure("Cold", HOT_MAX, TEST_MAX, 1);
+		phase();
+
+		// Hot keys stop at an upper level, never visiting the cold ones
+		EXPECT(true, hot < cold);
+		test_layers();
+		phase();
+
+		report();
+	}
+
+public:
+	LookupTest(const std::string &dir, bool v=true) : Test(dir, v), dir(dir)
+	{
+	}
+
+	void start_test(void *args = NULL) override
+	{
+		std::cout << "KVStore Lookup Test" << std::endl;
+		prepare();
+		test();
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+	std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+	std::cout << "  -v: print extra info for failed tests [currently ";
+	std::cout << (verbose ? "ON" : "OFF")<< "]" << std::endl;
+	std::cout << std::endl;
+	std::cout.flush();
+
+	LookupTest test("./data", verbose);
+	test.start_test();
+
+	return 0;
+}
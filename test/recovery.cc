@@ -0,0 +1,162 @@
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "SSTable.h"
+
+class RecoveryTest : public Test {
+private:
+	static const uint64_t TEST_MAX = 1024 * 8;
+	static const uint64_t TABLE_KEYS = 1024;
+
+	void test(uint64_t max)
+	{
+		uint64_t i;
+
+		// Data flushed to SSTables before the crash
+		for (i = 0; i < max; ++i) {
+			if (i & 1)
+				EXPECT(std::string(i+1, 'r'), store.get(i));
+			else
+				EXPECT(not_found, store.get(i));
+		}
+		phase();
+
+		// Data only held by the memTable (and the log) at the crash
+		for (i = 0; i < 64; ++i)
+			EXPECT(std::string(i+1, 'm'), store.get(max + i));
+		phase();
+
+		report();
+	}
+
+	static std::shared_ptr<SSTable> build_table(const std::string &level_dir, uint64_t ts, char c)
+	{
+		auto *data = new std::vector<value_type>;
+		for (uint64_t i = 0; i < TABLE_KEYS; ++i)
+			data->emplace_back(i, std::string(i % 64 + 1, c));
+		return std::make_shared<SSTable>(data, ts, level_dir);
+	}
+
+	static bool exists(const std::string &path)
+	{
+		return std::ifstream(path).good();
+	}
+
+public:
+	RecoveryTest(const std::string &dir, bool v=true) : Test(dir, v)
+	{
+	}
+
+	/**
+	 * Write data then exit without running any destructor,
+	 * so nothing in memory is flushed by KVStore::~KVStore.
+	 */
+	static void crash_after_writes(const std::string &dir, SyncMode mode)
+	{
+		const uint64_t max = TEST_MAX;
+		Options options;
+		options.sync_mode = mode;
+		auto *crashed = new KVStore(dir, options);
+		crashed->reset();
+
+		for (uint64_t i = 0; i < max; ++i)
+			crashed->put(i, std::string(i+1, 'r'));
+		for (uint64_t i = 0; i < max; i += 2)
+			crashed->del(i);
+		for (uint64_t i = 0; i < 64; ++i)
+			crashed->put(max + i, std::string(i+1, 'm'));
+
+		_exit(0);
+	}
+
+	void start_test(void *args = NULL) override
+	{
+		std::cout << "KVStore Recovery Test" << std::endl;
+		test(TEST_MAX);
+	}
+
+	/**
+	 * Two level-0 tables merged into level-1, marked obsolete the way a
+	 * compaction does. A reader holding the older input keeps the newer one
+	 * on disk too: a restart meanwhile must not find the older input above
+	 * the merged table without the newer one, its stale values would win.
+	 */
+	void compacted_test(const std::string &dir)
+	{
+		std::string compacted_dir = dir + "/compacted";
+		remove_store(compacted_dir);
+		utils::mkdir(compacted_dir.c_str());
+		utils::mkdir((compacted_dir + "/level-0").c_str());
+		utils::mkdir((compacted_dir + "/level-1").c_str());
+
+		auto older = build_table(compacted_dir + "/level-0", 1, 'o');
+		auto newer = build_table(compacted_dir + "/level-0", 2, 'n');
+		build_table(compacted_dir + "/level-1", 3, 'n');
+		std::string older_path = older->get_table_path();
+		std::string newer_path = newer->get_table_path();
+
+		// inputs are newest first, each one handed the one before it
+		newer->mark_obsolete();
+		older->mark_obsolete(newer);
+		newer.reset();
+		EXPECT(true, exists(newer_path));
+		EXPECT(true, exists(older_path));
+		phase();
+
+		{
+			// the process dies while the older input is still held
+			KVStore restarted(compacted_dir);
+			for (uint64_t i = 0; i < TABLE_KEYS; ++i)
+				EXPECT(std::string(i % 64 + 1, 'n'), restarted.get(i));
+		}
+		phase();
+
+		older.reset();
+		EXPECT(false, exists(older_path));
+		EXPECT(false, exists(newer_path));
+		phase();
+
+		remove_store(compacted_dir);
+		report();
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+	std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+	std::cout << "  -v: print extra info for failed tests [currently ";
+	std::cout << (verbose ? "ON" : "OFF")<< "]" << std::endl;
+	std::cout << std::endl;
+	std::cout.flush();
+
+	const SyncMode modes[] = {
+		SyncMode::EVERY_WRITE, SyncMode::GROUP_COMMIT, SyncMode::PERIODIC
+	};
+	const char *mode_names[] = {"every write", "group commit", "periodic"};
+
+	for (int m = 0; m < 3; ++m) {
+		std::cout << "[Sync mode: " << mode_names[m] << "]" << std::endl;
+		pid_t pid = fork();
+		if (pid == 0)
+			RecoveryTest::crash_after_writes("./data", modes[m]);
+		waitpid(pid, nullptr, 0);
+
+		RecoveryTest test("./data", verbose);
+		test.start_test();
+	}
+
+	std::cout << "[Compaction cut short]" << std::endl;
+	RecoveryTest test("./data", verbose);
+	test.compacted_test("./data");
+
+	return 0;
+}
@@ -0,0 +1,276 @@
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <map>
+#include <vector>
+
+#include "test.h"
+#include "SSTable.h"
+#include "utils.h"
+
+class ScanTest : public Test {
+private:
+	static const uint64_t TEST_MAX = 1024 * 64;
+
+	std::map<uint64_t, std::string> model;
+
+	const std::string dir;
+	const Options options;
+
+	void put(uint64_t key, const std::string &s)
+	{
+		store.put(key, s);
+		model[key] = s;
+	}
+
+	void del(uint64_t key)
+	{
+		store.del(key);
+		model.erase(key);
+	}
+
+	/**
+	 * Keys spread over several levels, newer versions and deletions
+	 * left in upper levels & the memTable.
+	 */
+	void prepare()
+	{
+		uint64_t i;
+		for (i = 0; i < TEST_MAX; ++i)
+			put(i * 2, std::string(i % 512 + 1, 's'));
+		for (i = 0; i < TEST_MAX; i += 3)
+			put(i * 2, std::string(i % 64 + 1, 'n'));
+		for (i = 0; i < TEST_MAX; i += 5)
+			del(i * 2);
+		for (i = 0; i < 1024; ++i)
+			put(i * 2 + 1, std::string(i % 16 + 1, 'm'));
+	}
+
+	/**
+	 * A scan reaching a broken data block stops there and reports it,
+	 * rather than moving on to the next table and looking complete.
+	 */
+	void corrupt_test()
+	{
+		const uint64_t count = 4096;
+		std::string corrupt_dir = dir + "/corrupt";
+		remove_store(corrupt_dir);
+		utils::mkdir(corrupt_dir.c_str());
+		// two tables walked by a level iterator, as tables below level-0 are:
+		// the first one broken, the second one intact
+		std::string level_dir = corrupt_dir + "/level-1";
+		utils::mkdir((corrupt_dir + "/level-0").c_str());
+		utils::mkdir(level_dir.c_str());
+		std::string path;
+		for (uint64_t t = 0; t < 2; ++t) {
+			auto *data = new std::vector<value_type>;
+			for (uint64_t i = t * count; i < (t + 1) * count; ++i)
+				data->emplace_back(i, std::string(i % 256 + 1, 'c'));
+			std::string written = SSTable(data, t + 1, level_dir, TableOptions(options)).get_table_path();
+			if (t == 0)
+				path = written;
+		}
+
+		corrupt_file(path);
+
+		{
+			KVStore corrupt(corrupt_dir, options);
+			uint64_t visited = 0;
+			Status status = corrupt.scan(0, count * 2, [&](uint64_t key, const std::string &s) {
+				EXPECT(visited++, key);
+			});
+			EXPECT(true, status == Status::CORRUPTION);
+			EXPECT(true, visited > 0 && visited < count);
+
+			auto itr = corrupt.new_iterator();
+			uint64_t backward = 0;
+			for (itr->seek_to_last(); itr->valid(); itr->prev())
+				++backward;
+			EXPECT(true, itr->status() == Status::CORRUPTION);
+			EXPECT(true, backward > count && backward < count * 2);
+		}
+		remove_store(corrupt_dir);
+	}
+
+	/**
+	 * Sorted runs left in level-1 by universal compaction overlap each other,
+	 * a store reopened with leveled compaction must merge them newest first.
+	 */
+	void style_switch_test()
+	{
+		const uint64_t count = 3000;
+		std::string switch_dir = dir + "/switch";
+		remove_store(switch_dir);
+		utils::mkdir(switch_dir.c_str());
+		{
+			Options universal = options;
+			universal.compaction_style = CompactionStyle::UNIVERSAL;
+			universal.universal_max_runs = 8;
+			KVStore tiered(switch_dir, universal);
+			for (uint64_t i = 0; i < count; ++i)
+				tiered.put(i, std::string(4096, 'A'));
+			for (uint64_t i = 0; i < count; ++i)
+				tiered.put(i, std::string(4096, 'B'));
+		}
+		for (int reopen = 0; reopen < 2; ++reopen) {
+			Options leveled = options;
+			leveled.compaction_style = CompactionStyle::LEVELED;
+			KVStore switched(switch_dir, leveled);
+			if (!reopen) {
+				for (uint64_t i = 0; i < count; i += 2)
+					switched.put(i, std::string(4096, 'C'));
+			}
+			for (uint64_t i = 0; i < count; ++i)
+				EXPECT(std::string(4096, i & 1 ? 'B' : 'C'), switched.get(i));
+		}
+		remove_store(switch_dir);
+	}
+
+	void test()
+	{
+		// Forward over all keys
+		auto itr = store.new_iterator();
+		auto expected = model.begin();
+		for (itr->seek_to_first(); itr->valid(); itr->next(), ++expected) {
+			if (expected == model.end())
+				break;
+			EXPECT(expected->first, itr->key());
+			EXPECT(expected->second, itr->value().to_string());
+		}
+		EXPECT(true, expected == model.end());
+		EXPECT(false, itr->valid());
+		phase();
+
+		// Backward over all keys
+		auto r_expected = model.rbegin();
+		for (itr->seek_to_last(); itr->valid(); itr->prev(), ++r_expected) {
+			if (r_expected == model.rend())
+				break;
+			EXPECT(r_expected->first, itr->key());
+			EXPECT(r_expected->second, itr->value().to_string());
+		}
+		EXPECT(true, r_expected == model.rend());
+		phase();
+
+		// Ranges
+		for (uint64_t start = 0; start < TEST_MAX * 2; start += TEST_MAX / 7) {
+			uint64_t end = start + TEST_MAX / 13;
+			auto range_expected = model.lower_bound(start);
+			uint64_t visited = 0;
+			store.scan(start, end, [&](uint64_t key, const std::string &s) {
+				EXPECT(range_expected->first, key);
+				EXPECT(range_expected->second, s);
+				++range_expected;
+				++visited;
+			});
+			uint64_t expected_count = 0;
+			for (auto e = model.lower_bound(start); e != model.end() && e->first <= end; ++e)
+				++expected_count;
+			EXPECT(expected_count, visited);
+		}
+
+		// Narrow ranges, mostly empty, and ranges past the last key
+		for (uint64_t start = 1; start < TEST_MAX * 4; start += TEST_MAX / 9) {
+			uint64_t end = start + start % 4;
+			uint64_t visited = 0, expected_count = 0;
+			store.scan(start, end, [&](uint64_t key, const std::string &s) {
+				EXPECT(model[key], s);
+				++visited;
+			});
+			for (auto e = model.lower_bound(start); e != model.end() && e->first <= end; ++e)
+				++expected_count;
+			EXPECT(expected_count, visited);
+		}
+		phase();
+
+		// Changing direction, keys away from both ends
+		for (uint64_t key = TEST_MAX / 5; key < TEST_MAX * 2 - TEST_MAX / 5; key += TEST_MAX / 5) {
+			auto at = model.lower_bound(key);
+			itr->seek(key);
+			EXPECT(at->first, itr->key());
+			itr->next();
+			EXPECT(std::next(at)->first, itr->key());
+			itr->prev();
+			itr->prev();
+			EXPECT(std::prev(at)->first, itr->key());
+			itr->seek_for_prev(key);
+			EXPECT(std::prev(model.upper_bound(key))->first, itr->key());
+		}
+		phase();
+
+		// Point reads through PinnedValue
+		PinnedValue value;
+		for (uint64_t key = 0; key < TEST_MAX * 2; ++key) {
+			auto found = model.find(key);
+			EXPECT(found != model.end(), store.get(key, value));
+			if (found != model.end())
+				EXPECT(found->second, value.to_string());
+		}
+
+		// A pinned value outlives overwrites and flushes of its key
+		std::string old_value = model[1];
+		EXPECT(true, store.get(1, value));
+		put(1, std::string(4096, 'o'));
+		for (uint64_t i = 0; i < 1024; ++i)
+			put(i * 2 + 1, std::string(1024, 'o'));
+		EXPECT(old_value, value.to_string());
+		EXPECT(true, store.get(1, value));
+		EXPECT(model[1], value.to_string());
+		phase();
+
+		corrupt_test();
+		phase();
+
+		style_switch_test();
+		phase();
+
+		report();
+	}
+
+public:
+	ScanTest(const std::string &dir, bool v=true, const Options &options=Options()) :
+		Test(dir, v, options), dir(dir), options(options)
+	{
+	}
+
+	void start_test(void *args = NULL) override
+	{
+		std::cout << "KVStore Scan Test" << std::endl;
+		store.reset();
+		prepare();
+		test();
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+	std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+	std::cout << "  -v: print extra info for failed tests [currently ";
+	std::cout << (verbose ? "ON" : "OFF")<< "]" << std::endl;
+	std::cout << std::endl;
+	std::cout.flush();
+
+	const char *mode_names[] = {"pread", "mmap", "pread, range filter & partitioned index",
+				    "pread, universal compaction"};
+
+	for (int m = 0; m < 4; ++m) {
+		std::cout << "[Read mode: " << mode_names[m] << "]" << std::endl;
+		Options options;
+		options.mmap_reads = (m == 1);
+		if (m == 2) {
+			options.range_filter_bits_per_prefix = 10;
+			options.partition_index = true;
+		}
+		if (m == 3) {
+			// sorted runs of level-1 merged often
+			options.compaction_style = CompactionStyle::UNIVERSAL;
+			options.universal_max_runs = 2;
+		}
+		ScanTest test("./data", verbose, options);
+		test.start_test();
+	}
+
+	return 0;
+}
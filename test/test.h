@@ -1,10 +1,13 @@
 #pragma once
 
 #include <iostream>
+#include <fstream>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "kvstore.h"
+#include "utils.h"
 
 class Test {
 protected:
@@ -63,11 +66,52 @@ protected:
 		nr_passed_phases = 0;
 	}
 
+	/**
+	 * Remove the files of dir and of its level directories, then dir.
+	 */
+	static void remove_store(const std::string &store_dir)
+	{
+		if (!utils::dirExists(store_dir))
+			return;
+		std::vector<std::string> entries;
+		utils::scanDir(store_dir, entries);
+		for (auto &entry : entries) {
+			std::string path = store_dir + "/" + entry;
+			if (!utils::dirExists(path)) {
+				utils::rmfile(path.c_str());
+				continue;
+			}
+			std::vector<std::string> files;
+			utils::scanDir(path, files);
+			for (auto &file : files)
+				utils::rmfile((path + "/" + file).c_str());
+			utils::rmdir(path.c_str());
+		}
+		utils::rmdir(store_dir.c_str());
+	}
+
+	/**
+	 * Flip a byte in the middle of a file, amid the data blocks of an SSTable.
+	 */
+	static void corrupt_file(const std::string &path)
+	{
+		std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekg(0, std::ios::end);
+		std::streamoff middle = file.tellg() / 2;
+		char byte;
+		file.seekg(middle);
+		file.get(byte);
+		file.seekp(middle);
+		file.put((char)~byte);
+		file.close();
+	}
+
 	class KVStore store;
 	bool verbose;
 
 public:
-	Test(const std::string &dir, bool v=true): store(dir), verbose(v)
+	Test(const std::string &dir, bool v=true, const Options &options=Options()):
+		store(dir, options), verbose(v)
 	{
 		nr_tests = 0;
 		nr_passed_tests = 0;